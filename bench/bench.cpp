@@ -0,0 +1,364 @@
+// Benchmark of bundled scenes: load, build and render times at fixed settings, as JSON
+#include "scene.h"
+#include "thread_pool.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <map>
+#include <cstring>
+
+namespace
+{
+	struct Settings
+	{
+		std::string sceneDir = "input";
+		std::vector<std::string> scenes;	// scene files given instead of directory
+		size_t width = 320, height = 240;
+		std::vector<size_t> threads;
+		int warmup = 1;
+		int runs = 5;
+		std::string output;
+		std::string baseline;
+		double threshold = 10;	// allowed slowdown against baseline in percent
+		bool perf = false;	// count hardware events of measured runs
+	};
+
+	// Median, 90th percentile and extremes of repeated measurements
+	struct Summary
+	{
+		double median = 0, p90 = 0, min = 0, max = 0;
+	};
+
+	struct Result
+	{
+		std::string scene;
+		size_t threads = 0;
+		size_t rays = 0;
+		Summary load, build, render, mrays;
+		// Medians of performance counters by phase, events not in mask were not counted
+		uint64_t perf[perfPhaseCount][perfEventCount] = {};
+		unsigned perfEvents = 0;
+	};
+
+	Summary summarize(std::vector<double> values)
+	{
+		// Nearest rank percentiles
+		std::sort(values.begin(), values.end());
+		auto rank = [&values](double p) {
+			return values[std::min(values.size() - 1, (size_t)std::ceil(p * values.size()) - (p > 0 ? 1 : 0))];
+		};
+		return Summary{ rank(0.5), rank(0.9), values.front(), values.back() };
+	}
+
+	double milliseconds(std::chrono::steady_clock::duration duration)
+	{
+		return std::chrono::duration<double, std::milli>(duration).count();
+	}
+
+	// Scene output goes to stdout, it is dropped while scenes are measured
+	class Silence
+	{
+	public:
+		Silence() : saved(std::cout.rdbuf(nullptr)) {}
+		~Silence() { std::cout.rdbuf(saved); }
+
+	private:
+		std::streambuf* saved;
+	};
+
+	struct Run
+	{
+		bool loaded = false;
+		double load = 0, build = 0, render = 0;
+		size_t rays = 0;
+		uint64_t perf[perfPhaseCount][perfEventCount] = {};
+		unsigned perfEvents = 0;
+	};
+
+	// Load and render scene once with fixed resolution and threads, image is not written
+	Run runScene(const std::string& path, const Settings& settings, ThreadPool& pool, bool countRays)
+	{
+		Silence silence;
+		Run run;
+		Scene scene;
+		scene.pool = &pool;
+		// Set before loading, as meshes are loaded while scene is parsed
+		scene.options.perfCounters = settings.perf && !countRays;
+		auto start = std::chrono::steady_clock::now();
+		scene.sceneLoadSuccess = scene.loadScene(path);
+		run.load = milliseconds(std::chrono::steady_clock::now() - start);
+		run.build = scene.stats.acBuildTime / 1000.0;
+		if (!scene.sceneLoadSuccess)
+			return run;
+		run.loaded = true;
+
+		Options& options = scene.options;
+		options.width = settings.width;
+		options.height = settings.height;
+		options.nWorkers = (int)pool.size();
+		options.imageOutput = false;
+		options.outputProgress = false;
+		options.enableOutput = false;
+		options.timeBudget = 0;
+		options.checkpoint = false;
+		// Counting rays slows tracing down, so it is done by a separate run
+		options.collectStatistics = countRays;
+		if (scene.animation.enabled())
+			scene.setFrame(scene.animation.firstFrame);
+
+		std::vector<Vec3f> frameBuffer(settings.width * settings.height);
+		start = std::chrono::steady_clock::now();
+		scene.render(frameBuffer.data());
+		run.render = milliseconds(std::chrono::steady_clock::now() - start);
+		run.rays = scene.stats.raysCasted;
+		for (int phase = 0; phase < perfPhaseCount; phase++)
+			for (int event = 0; event < perfEventCount; event++)
+				run.perf[phase][event] = scene.stats.perf[phase][event];
+		run.perfEvents = scene.stats.perfEvents;
+		return run;
+	}
+
+	void writeSummary(std::ostream& out, const char* name, const Summary& summary)
+	{
+		out << '"' << name << "\": { \"median\": " << summary.median << ", \"p90\": " << summary.p90
+			<< ", \"min\": " << summary.min << ", \"max\": " << summary.max << " }";
+	}
+
+	void writePerf(std::ostream& out, const Result& result)
+	{
+		const char* const phases[perfPhaseCount] = { "load", "build", "render" };
+		out << ", \"perf\": { ";
+		for (int phase = 0; phase < perfPhaseCount; phase++) {
+			out << (phase ? " }, \"" : "\"") << phases[phase] << "\": { ";
+			bool first = true;
+			for (int event = 0; event < perfEventCount; event++) {
+				if (!(result.perfEvents & (1u << event)))
+					continue;
+				out << (first ? "\"" : ", \"") << PerfCounters::eventName(event) << "\": " << result.perf[phase][event];
+				first = false;
+			}
+		}
+		out << " } }";
+	}
+
+	// Results are written one per line, so that baseline can be read line by line
+	void writeJSON(std::ostream& out, const Settings& settings, const std::vector<Result>& results)
+	{
+		out << std::fixed << std::setprecision(3);
+		out << "{\n\"width\": " << settings.width << ", \"height\": " << settings.height
+			<< ", \"warmup\": " << settings.warmup << ", \"runs\": " << settings.runs << ",\n\"results\": [\n";
+		for (size_t i = 0; i < results.size(); i++) {
+			const Result& result = results[i];
+			out << "{ \"scene\": \"" << result.scene << "\", \"threads\": " << result.threads << ", \"rays\": " << result.rays << ", ";
+			writeSummary(out, "load_ms", result.load);
+			out << ", ";
+			writeSummary(out, "build_ms", result.build);
+			out << ", ";
+			writeSummary(out, "render_ms", result.render);
+			out << ", ";
+			writeSummary(out, "mrays_per_s", result.mrays);
+			if (result.perfEvents)
+				writePerf(out, result);
+			out << (i + 1 < results.size() ? " },\n" : " }\n");
+		}
+		out << "]\n}\n";
+	}
+
+	// Number following "key": in line, negative if key is missing
+	double findNumber(const std::string& line, const std::string& key, size_t from = 0)
+	{
+		size_t pos = line.find('"' + key + "\":", from);
+		if (pos == std::string::npos)
+			return -1;
+		return std::strtod(line.c_str() + pos + key.size() + 3, nullptr);
+	}
+
+	// Median render time of every scene and thread count in baseline written by this benchmark
+	bool readBaseline(const std::string& path, std::map<std::pair<std::string, size_t>, double>& baseline)
+	{
+		std::ifstream file(path);
+		if (!file)
+			return false;
+		std::string line;
+		while (std::getline(file, line)) {
+			size_t scene = line.find("\"scene\": \"");
+			size_t render = line.find("\"render_ms\":");
+			if (scene == std::string::npos || render == std::string::npos)
+				continue;
+			scene += 10;
+			const std::string name = line.substr(scene, line.find('"', scene) - scene);
+			baseline[{ name, (size_t)findNumber(line, "threads") }] = findNumber(line, "median", render);
+		}
+		return true;
+	}
+
+	std::vector<size_t> parseList(const std::string& text)
+	{
+		std::vector<size_t> values;
+		std::stringstream stream(text);
+		std::string item;
+		while (std::getline(stream, item, ','))
+			values.push_back(std::stoul(item));
+		return values;
+	}
+
+	void printUsage()
+	{
+		std::cout << "Usage: RayTracing_bench [--scenes <dir> | <scene>...] [--size <width>x<height>] [--threads <n,m,...>]\n"
+			"    [--warmup <runs>] [--runs <runs>] [--output <json>] [--baseline <json>] [--threshold <percent>] [--perf]\n";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Settings settings;
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		if (arg.compare(0, 2, "--") != 0) {
+			settings.scenes.push_back(arg);
+			continue;
+		}
+		if (arg == "--perf") {
+			settings.perf = true;
+			continue;
+		}
+		if (i + 1 >= argc) {
+			printUsage();
+			return 1;
+		}
+		const std::string value = argv[++i];
+		if (arg == "--scenes")
+			settings.sceneDir = value;
+		else if (arg == "--size")
+			settings.width = std::stoul(value), settings.height = std::stoul(value.substr(value.find('x') + 1));
+		else if (arg == "--threads")
+			settings.threads = parseList(value);
+		else if (arg == "--warmup")
+			settings.warmup = std::stoi(value);
+		else if (arg == "--runs")
+			settings.runs = std::max(1, std::stoi(value));
+		else if (arg == "--output")
+			settings.output = value;
+		else if (arg == "--baseline")
+			settings.baseline = value;
+		else if (arg == "--threshold")
+			settings.threshold = std::stod(value);
+		else {
+			printUsage();
+			return 1;
+		}
+	}
+	// One thread and all cores by default
+	if (settings.threads.empty()) {
+		settings.threads.push_back(1);
+		if (std::thread::hardware_concurrency() > 1)
+			settings.threads.push_back(std::thread::hardware_concurrency());
+	}
+
+	std::vector<std::string> scenes = settings.scenes;
+	if (scenes.empty()) {
+		std::error_code error;
+		for (const auto& entry : std::filesystem::directory_iterator(settings.sceneDir, error))
+			if (entry.path().extension() == ".scene")
+				scenes.push_back(entry.path().string());
+		std::sort(scenes.begin(), scenes.end());
+	}
+	if (scenes.empty()) {
+		std::cout << "No scenes found in " << settings.sceneDir << '\n';
+		return 1;
+	}
+
+	std::vector<Result> results;
+	for (size_t threads : settings.threads) {
+		ThreadPool pool(threads);
+		for (const std::string& path : scenes) {
+			const std::string name = std::filesystem::path(path).stem().string();
+			Run run = runScene(path, settings, pool, true);
+			if (!run.loaded) {
+				std::cout << name << ": could not be loaded, skipped\n";
+				continue;
+			}
+			for (int i = 0; i < settings.warmup; i++)
+				runScene(path, settings, pool, false);
+
+			Result result;
+			result.scene = name;
+			result.threads = threads;
+			result.rays = run.rays;
+			std::vector<double> load, build, render, mrays;
+			std::vector<double> perf[perfPhaseCount][perfEventCount];
+			result.perfEvents = ~0u;
+			for (int i = 0; i < settings.runs; i++) {
+				run = runScene(path, settings, pool, false);
+				load.push_back(run.load);
+				build.push_back(run.build);
+				render.push_back(run.render);
+				mrays.push_back(result.rays / std::max(run.render, 1e-3) / 1000.0);
+				for (int phase = 0; phase < perfPhaseCount; phase++)
+					for (int event = 0; event < perfEventCount; event++)
+						perf[phase][event].push_back((double)run.perf[phase][event]);
+				result.perfEvents &= run.perfEvents;
+			}
+			for (int phase = 0; phase < perfPhaseCount; phase++)
+				for (int event = 0; event < perfEventCount; event++)
+					result.perf[phase][event] = (uint64_t)summarize(perf[phase][event]).median;
+			result.load = summarize(load);
+			result.build = summarize(build);
+			result.render = summarize(render);
+			result.mrays = summarize(mrays);
+			results.push_back(result);
+			std::cout << std::fixed << std::setprecision(1) << std::setw(28) << std::left << name << std::right
+				<< std::setw(3) << threads << " threads  load " << std::setw(8) << result.load.median
+				<< " ms  build " << std::setw(8) << result.build.median << " ms  render " << std::setw(9)
+				<< result.render.median << " ms (p90 " << result.render.p90 << ")  " << std::setprecision(2)
+				<< result.mrays.median << " Mrays/s";
+			// Instructions per cycle of render, if both were counted
+			if ((result.perfEvents & 3u) == 3u && result.perf[(int)PerfPhase::Render][0])
+				std::cout << "  IPC " << (double)result.perf[(int)PerfPhase::Render][1] / result.perf[(int)PerfPhase::Render][0];
+			std::cout << '\n';
+		}
+	}
+
+	if (!settings.output.empty()) {
+		std::ofstream file(settings.output);
+		writeJSON(file, settings, results);
+		if (!file) {
+			std::cout << "Could not write " << settings.output << '\n';
+			return 1;
+		}
+		std::cout << "Results written to " << settings.output << '\n';
+	}
+	else {
+		writeJSON(std::cout, settings, results);
+	}
+
+	// Median render time slower than baseline by more than threshold is a regression
+	if (settings.baseline.empty())
+		return 0;
+	std::map<std::pair<std::string, size_t>, double> baseline;
+	if (!readBaseline(settings.baseline, baseline)) {
+		std::cout << "Could not read baseline " << settings.baseline << '\n';
+		return 1;
+	}
+	size_t regressions = 0;
+	std::cout << std::fixed << std::setprecision(1);
+	for (const Result& result : results) {
+		auto base = baseline.find({ result.scene, result.threads });
+		if (base == baseline.end() || base->second <= 0)
+			continue;
+		const double change = (result.render.median / base->second - 1) * 100;
+		const bool regression = change > settings.threshold;
+		regressions += regression;
+		std::cout << (regression ? "REGRESSION " : "           ") << std::setw(28) << std::left << result.scene
+			<< std::right << std::setw(3) << result.threads << " threads  " << std::showpos << change
+			<< std::noshowpos << "% (" << base->second << " -> " << result.render.median << " ms)\n";
+	}
+	std::cout << regressions << " regressions beyond " << settings.threshold << "%\n";
+	return regressions ? 2 : 0;
+}
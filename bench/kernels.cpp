@@ -0,0 +1,311 @@
+// Microbenchmark of intersection kernels with synthetic ray sets shot at bundled meshes
+#include "scene.h"
+
+#include <iostream>
+#include <iomanip>
+#include <filesystem>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+	struct Settings
+	{
+		std::vector<std::string> meshes;
+		size_t rays = 1 << 16;
+		double minTime = 100;	// ms a measurement has to run for
+		int repeats = 5;	// fastest of repeated measurements is reported
+	};
+
+	// Rays of one kind, and for each the triangle it hits first or nullptr
+	struct RaySet
+	{
+		std::string name;
+		std::vector<Ray> rays;
+		std::vector<const Triangle*> hits;
+	};
+
+	struct Measure
+	{
+		double ns = 0;	// per call of kernel
+		double hitRate = 0;
+	};
+
+	/* Kernel pass calls kernel for every ray of set and returns number of hits.
+	 * Passes are repeated until they take minTime, time per call of the fastest
+	 * of repeated measurements is reported, so that other load shows less */
+	template<typename Pass>
+	Measure measure(const Settings& settings, size_t calls, const Pass& pass)
+	{
+		Measure result;
+		result.hitRate = calls ? (double)pass() / calls : 0;
+		result.ns = std::numeric_limits<double>::max();
+		for (int repeat = 0; repeat < settings.repeats; repeat++) {
+			size_t passes = 0;
+			auto start = std::chrono::steady_clock::now();
+			double elapsed = 0;
+			do {
+				pass();
+				passes++;
+				elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+			} while (elapsed < settings.minTime * 1e6);
+			result.ns = std::min(result.ns, elapsed / ((double)passes * std::max<size_t>(1, calls)));
+		}
+		return result;
+	}
+
+	// Unit vector around normal with cosine weighted density
+	Vec3f cosineDirection(const Vec3f& normal, std::mt19937& rng)
+	{
+		std::uniform_real_distribution<float> uniform(0, 1);
+		const float r = std::sqrt(uniform(rng)), phi = 2 * (float)M_PI * uniform(rng);
+		const Vec3f helper = std::fabs(normal.x) > 0.9f ? Vec3f{ 0, 1, 0 } : Vec3f{ 1, 0, 0 };
+		Vec3f tangent = helper.crossProduct(normal);
+		tangent.normalize();
+		const Vec3f bitangent = normal.crossProduct(tangent);
+		Vec3f dir = tangent * (r * std::cos(phi)) + bitangent * (r * std::sin(phi)) +
+			normal * std::sqrt(std::max(0.0f, 1 - r * r));
+		dir.normalize();
+		return dir;
+	}
+
+	/* Coherent primary rays in scanline order from a pinhole in front of the mesh,
+	 * covering its bounding sphere. Their hit points are origins of incoherent
+	 * diffuse rays in random order, and of shadow rays towards a point light */
+	std::vector<RaySet> makeRaySets(const AccelerationStructure& ac, size_t count, TraceState& state)
+	{
+		const Vec3f center = (ac.bounds[0] + ac.bounds[1]) * 0.5f;
+		const float radius = (ac.bounds[1] - ac.bounds[0]).length() * 0.5f;
+		const Vec3f eye = center + Vec3f{ 0, 0, 3 * radius };
+		const Vec3f light = center + Vec3f{ 2 * radius, 3 * radius, 2 * radius };
+		const size_t side = std::max<size_t>(1, (size_t)std::sqrt((double)count));
+
+		std::vector<RaySet> sets(3);
+		sets[0].name = "primary";
+		sets[1].name = "diffuse";
+		sets[2].name = "shadow";
+		for (size_t y = 0; y < side; y++) {
+			for (size_t x = 0; x < side; x++) {
+				const Vec3f target = center + Vec3f{ ((x + 0.5f) / side * 2 - 1) * radius, (1 - (y + 0.5f) / side * 2) * radius, 0 };
+				Vec3f dir = target - eye;
+				dir.normalize();
+				sets[0].rays.emplace_back(eye, dir, RayType::PrimaryRay);
+			}
+		}
+
+		struct HitPoint { Vec3f pos, normal; };
+		std::vector<HitPoint> points;
+		for (const Ray& ray : sets[0].rays) {
+			float t;
+			Vec2f uv;
+			const Triangle* tri = nullptr;
+			if (!ac.intersectAccelStruct(ray, t, tri, uv, state)) {
+				sets[0].hits.push_back(nullptr);
+				continue;
+			}
+			sets[0].hits.push_back(tri);
+			Vec3f normal = (tri->b - tri->a).crossProduct(tri->c - tri->a);
+			normal.normalize();
+			if (normal.dotProduct(ray.dir) > 0)
+				normal = -normal;
+			points.push_back({ ray.orig + ray.dir * t + normal * (1e-4f * radius), normal });
+		}
+		if (points.empty())
+			return { sets[0] };
+
+		std::mt19937 rng(1);
+		std::shuffle(points.begin(), points.end(), rng);
+		for (size_t i = 0; i < sets[0].rays.size(); i++) {
+			const HitPoint& point = points[i % points.size()];
+			sets[1].rays.emplace_back(point.pos, cosineDirection(point.normal, rng), RayType::ReflectionRay);
+			Vec3f toLight = light - point.pos;
+			toLight.normalize();
+			sets[2].rays.emplace_back(point.pos, toLight, RayType::ShadowRay);
+		}
+		for (size_t set = 1; set < 3; set++) {
+			for (const Ray& ray : sets[set].rays) {
+				float t;
+				Vec2f uv;
+				const Triangle* tri = nullptr;
+				sets[set].hits.push_back(ac.intersectAccelStruct(ray, t, tri, uv, state) ? tri : nullptr);
+			}
+		}
+		return sets;
+	}
+
+	void collectNodes(const AccelerationStructure* node, int depth, std::vector<const AccelerationStructure*>& nodes)
+	{
+		if (!node)
+			return;
+		nodes.push_back(node);
+		if (depth > 0) {
+			collectNodes(node->left.get(), depth - 1, nodes);
+			collectNodes(node->right.get(), depth - 1, nodes);
+		}
+	}
+
+	// Synthetic skybox with different color on every face, it is owned and freed by scene
+	void makeSkybox(Scene& scene, int size)
+	{
+		scene.options.useSkybox = true;
+		scene.skyboxWidth = scene.skyboxHeight = size;
+		for (int k = 0; k < 6; k++) {
+			scene.skyboxes[k] = new Vec3f[size * (size_t)size];
+			for (int i = 0; i < size * size; i++)
+				scene.skyboxes[k][i] = Vec3f{ k / 6.0f, (i / size) / (float)size, (i % size) / (float)size };
+		}
+	}
+
+	void printRow(const std::string& kernel, const std::string& set, const Measure& m)
+	{
+		std::cout << std::left << std::setw(16) << kernel << std::setw(9) << set << std::right << std::fixed
+			<< std::setprecision(2) << std::setw(10) << m.ns << std::setw(12) << 1e3 / m.ns
+			<< std::setprecision(1) << std::setw(9) << m.hitRate * 100 << "%\n";
+	}
+
+	bool benchMesh(const std::string& path, const Settings& settings)
+	{
+		Scene scene;
+		{
+			// Loading prints to stdout
+			std::streambuf* saved = std::cout.rdbuf(nullptr);
+			scene.sceneLoadSuccess = scene.loadSceneText("[options]\n[object]\ntype=mesh\npos=0,0,0\nsize=2,2,2\nname=" +
+				path + "\n[end]\n", path);
+			std::cout.rdbuf(saved);
+		}
+		if (!scene.sceneLoadSuccess || scene.objects.empty()) {
+			std::cout << path << ": could not be loaded, skipped\n\n";
+			return false;
+		}
+		const Mesh& mesh = static_cast<const Mesh&>(*scene.objects[0]);
+		const AccelerationStructure& ac = *mesh.geometry->ac;
+		makeSkybox(scene, 512);
+		RenderContext ctx(scene);
+
+		Counters counters;
+		TraceState state{ ctx.options, counters, Quality(ctx.options) };
+		const std::vector<RaySet> sets = makeRaySets(ac, settings.rays, state);
+
+		const Vec3f center = (ac.bounds[0] + ac.bounds[1]) * 0.5f;
+		const float radius = (ac.bounds[1] - ac.bounds[0]).length() * 0.5f;
+		const Sphere sphere(center, radius * 0.5f);
+		const Plane plane(Vec3f{ center.x, ac.bounds[0].y, center.z }, Vec3f{ 0, 1, 0 });
+		std::vector<const AccelerationStructure*> nodes;
+		collectNodes(&ac, 3, nodes);
+		std::vector<const Triangle*> randomTris(sets[0].rays.size());
+		std::mt19937 rng(2);
+		for (const Triangle*& tri : randomTris)
+			tri = mesh.geometry->tris[rng() % mesh.geometry->tris.size()];
+
+		std::cout << path << ": " << mesh.geometry->tris.size() << " triangles, " << sets[0].rays.size() << " rays per set\n";
+		std::cout << std::left << std::setw(16) << "kernel" << std::setw(9) << "rays" << std::right
+			<< std::setw(10) << "ns/call" << std::setw(12) << "Mcalls/s" << std::setw(10) << "hits" << '\n';
+		for (const RaySet& set : sets) {
+			const std::vector<Ray>& rays = set.rays;
+			// Every ray is tested against triangle it hits, if any, and a random one
+			printRow("triangle", set.name, measure(settings, 2 * rays.size(), [&]() {
+				size_t hits = 0;
+				float t;
+				Vec2f uv;
+				for (size_t i = 0; i < rays.size(); i++) {
+					hits += set.hits[i] && Triangle::rayTriangleIntersect(rays[i], set.hits[i], t, uv, state);
+					hits += Triangle::rayTriangleIntersect(rays[i], randomTris[i], t, uv, state);
+				}
+				return hits;
+			}));
+			// Boxes of the top four levels of tree
+			printRow("box", set.name, measure(settings, nodes.size() * rays.size(), [&]() {
+				size_t hits = 0;
+				for (const Ray& ray : rays)
+					for (const AccelerationStructure* node : nodes)
+						hits += node->intersectBox(ray, state);
+				return hits;
+			}));
+			printRow("tree", set.name, measure(settings, rays.size(), [&]() {
+				size_t hits = 0;
+				float t;
+				Vec2f uv;
+				const Triangle* tri;
+				for (const Ray& ray : rays)
+					hits += ac.intersectAccelStruct(ray, t, tri, uv, state);
+				return hits;
+			}));
+			printRow("sphere", set.name, measure(settings, rays.size(), [&]() {
+				size_t hits = 0;
+				float t;
+				Vec2f uv;
+				for (const Ray& ray : rays)
+					hits += sphere.intersectObject(ray, t, uv);
+				return hits;
+			}));
+			printRow("plane", set.name, measure(settings, rays.size(), [&]() {
+				size_t hits = 0;
+				float t;
+				Vec2f uv;
+				for (const Ray& ray : rays)
+					hits += plane.intersectObject(ray, t, uv);
+				return hits;
+			}));
+			// Hit rate of skybox is part of texels brighter than half
+			printRow("skybox", set.name, measure(settings, rays.size(), [&]() {
+				size_t hits = 0;
+				for (const Ray& ray : rays)
+					hits += ctx.getSkybox(ray.dir).y > 0.5f;
+				return hits;
+			}));
+		}
+		std::cout << '\n';
+		return true;
+	}
+
+	void printUsage()
+	{
+		std::cout << "Usage: RayTracing_kernels [<mesh.obj>...] [--rays <count>] [--time <ms>] [--repeat <count>]\n";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Settings settings;
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		if (arg.compare(0, 2, "--") != 0) {
+			settings.meshes.push_back(arg);
+			continue;
+		}
+		if (i + 1 >= argc) {
+			printUsage();
+			return 1;
+		}
+		const std::string value = argv[++i];
+		if (arg == "--rays")
+			settings.rays = std::max<size_t>(1, std::stoul(value));
+		else if (arg == "--time")
+			settings.minTime = std::stod(value);
+		else if (arg == "--repeat")
+			settings.repeats = std::max(1, std::stoi(value));
+		else {
+			printUsage();
+			return 1;
+		}
+	}
+	// Bundled meshes by default
+	if (settings.meshes.empty()) {
+		std::error_code error;
+		for (const auto& entry : std::filesystem::directory_iterator("input/objects", error))
+			if (entry.path().extension() == ".obj")
+				settings.meshes.push_back(entry.path().generic_string());
+		std::sort(settings.meshes.begin(), settings.meshes.end());
+	}
+	if (settings.meshes.empty()) {
+		std::cout << "No meshes found in input/objects\n";
+		return 1;
+	}
+
+	size_t benchmarked = 0;
+	for (const std::string& mesh : settings.meshes)
+		benchmarked += benchMesh(mesh, settings);
+	return benchmarked ? 0 : 1;
+}
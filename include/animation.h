@@ -0,0 +1,50 @@
+// Keyframed camera and object motion, rendered as a sequence of frames
+#pragma once
+
+#include <vector>
+
+#include "geometry.h"
+
+// Value keyed at some frames. It is interpolated linearly between keys and
+// held before the first and after the last key
+class Track
+{
+public:
+	// Set value at frame, key at the same frame is replaced
+	void addKey(int frame, const Vec3f& value);
+	Vec3f at(int frame) const;
+	bool empty() const { return keys.empty(); }
+
+private:
+	struct Key
+	{
+		int frame;
+		Vec3f value;
+	};
+	std::vector<Key> keys;	// sorted by frame
+};
+
+// Motion of one object, given by its index in scene objects
+struct ObjectMotion
+{
+	size_t object = 0;
+	Track pos;
+	Track rot;	// meshes only
+};
+
+/* Frames [firstFrame, lastFrame] of a scene. Camera, object positions and mesh
+ * rotations may be keyed, everything else stays as loaded for all frames */
+class Animation
+{
+public:
+	bool enabled() const { return firstFrame <= lastFrame; }
+
+	// Motion of object with given index, created on first use
+	ObjectMotion& object(size_t index);
+
+	int firstFrame = 0;
+	int lastFrame = -1;
+	Track cameraPos;
+	Track cameraRot;
+	std::vector<ObjectMotion> objects;
+};
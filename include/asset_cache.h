@@ -0,0 +1,54 @@
+// Least recently used cache of loaded meshes and textures, shared by scenes loaded one after another
+#pragma once
+
+#include <string>
+#include <memory>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+
+/* Assets loaded by earlier scenes, keyed by file and everything that changes
+ * the loaded asset. Assets are never changed once loaded. Evicted assets stay
+ * alive as long as some scene still uses them, capacity only limits what is
+ * kept for later scenes */
+class AssetCache
+{
+public:
+	AssetCache(size_t a_capacity);	// capacity in bytes
+
+	// Asset stored under key, on miss it is loaded with load() and kept if it was
+	// loaded. Loads run without lock, so the same asset may be loaded twice at once
+	template<typename T, typename Load>
+	std::shared_ptr<T> get(const std::string& key, Load&& load)
+	{
+		if (std::shared_ptr<void> cached = find(key))
+			return std::static_pointer_cast<T>(cached);
+		std::shared_ptr<T> asset = load();
+		if (asset)
+			insert(key, asset, asset->memorySize());
+		return asset;
+	}
+
+	// Bytes used by cached assets
+	size_t size() const;
+
+	std::atomic<size_t> hits{ 0 };
+	std::atomic<size_t> misses{ 0 };
+
+private:
+	std::shared_ptr<void> find(const std::string& key);
+	void insert(const std::string& key, std::shared_ptr<void> asset, size_t assetSize);
+
+	struct Entry
+	{
+		std::string key;
+		std::shared_ptr<void> asset;
+		size_t size;
+	};
+	std::list<Entry> entries;	// most recently used first
+	std::unordered_map<std::string, std::list<Entry>::iterator> index;
+	const size_t capacity;
+	size_t used = 0;
+	mutable std::mutex mutex;
+};
@@ -0,0 +1,46 @@
+// Checkpoint of tiled render, log of finished tiles that a stopped render resumes from
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <mutex>
+#include <vector>
+#include <chrono>
+
+#include "scene.h"
+
+/* File starts with size of image and tiles, followed by finished tiles in order
+ * they were done: tile index and float pixels of the tile. Tiles are appended as
+ * they finish and flushed at most every checkpoint_interval ms, so a killed
+ * render loses at most that much work. Pixels depend only on their position, so
+ * nothing else has to be kept to render the remaining tiles. A tile cut short
+ * by the kill is dropped when render resumes. Header also keeps hash of scene
+ * text, camera and options that change pixels, tiles of another scene are never
+ * resumed */
+class TileCheckpoint
+{
+public:
+	TileCheckpoint(const Options& options, uint64_t sourceHash, const Camera& camera);
+
+	// Start checkpoint file. With resume tiles of previous render are passed to
+	// onRestored and marked in doneTiles, file is then continued. Returns number
+	// of restored tiles
+	size_t open(bool resume, std::vector<char>& doneTiles, const TileCallback& onRestored);
+	bool good() const { return file.good(); }
+
+	// Append finished tile, may be called from any worker
+	void add(const Vec3f* pixels, size_t stride, size_t x0, size_t y0, size_t x1, size_t y1);
+	bool flush();
+	// Delete file once image is finished
+	void remove();
+
+	const std::string path;
+
+private:
+	const size_t width, height, tileSize, tilesX;
+	const uint64_t sceneHash;
+	const std::chrono::milliseconds interval;
+	std::ofstream file;
+	std::mutex mutex;
+	std::chrono::steady_clock::time_point lastFlush;
+};
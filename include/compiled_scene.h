@@ -0,0 +1,104 @@
+// Flat render-ready snapshot of a scene, compiled when render starts
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+class Scene;
+class Camera;
+
+#include "geometry.h"
+#include "objects.h"
+#include "options.h"
+
+/* Records are aligned to cache lines and none of them is larger than one, so
+ * every record is read with a single line. Everything that does not depend on
+ * the hit point is computed once, when scene is compiled */
+
+// Distant light, intensity is already multiplied by color
+struct alignas(64) DistantLightRecord
+{
+	Vec3f dir;
+	Vec3f intensity;
+};
+
+// Point light, intensity is color * min(1, power / squared distance)
+struct alignas(64) PointLightRecord
+{
+	Vec3f pos;
+	Vec3f color;
+	float power;
+};
+
+// Area light, shadow rays go to sampleCount points of parallelogram. Fixed points
+// are either the regular grid or just the center, they start at firstPoint of areaPoints
+struct alignas(64) AreaLightRecord
+{
+	Vec3f pos;
+	Vec3f i, j;
+	Vec3f color;
+	float power;
+	uint32_t sampleCount;
+	uint32_t firstPoint;
+	bool fixedPoints;
+};
+
+// Surface properties of an object, textured meshes look up their maps
+struct alignas(64) MaterialRecord
+{
+	MaterialType type;
+	Vec3f color;
+	float ambient, diffuse, specular, nSpecular;
+	float indexOfRefraction;
+	const Mesh* textures;	// mesh with diffuse or specular map, otherwise nullptr
+};
+
+// Object geometry. Spheres and planes are intersected straight from the record,
+// meshes through their acceleration structure
+struct alignas(64) ObjectRecord
+{
+	ObjectType type;
+	uint32_t material;	// index in material table
+	bool castsShadow;	// transparent objects do not cast shadows
+	Vec3f pos;
+	Vec3f normal;	// plane normal
+	float r2;		// squared sphere radius
+	const Object* object;	// source object, computes surface data at hit point
+	const AccelerationStructure* ac;
+};
+
+// Camera rotation baked into basis vectors, ray direction of image plane point
+// (x, y, -1) is x * right + y * up - back
+struct CameraBasis
+{
+	Vec3f pos;
+	Vec3f right, up, back;
+	float scale;	// half height of image plane at distance 1
+	float aspectRatio;
+
+	// Ray through image plane point, coordinates are in pixels of width x height image
+	Ray getRay(float x, float y, size_t width, size_t height) const;
+};
+
+/* Scene compiled for one render. Loader keeps polymorphic objects and lights,
+ * renderer reads only these flat arrays, so shading needs neither casts nor
+ * lazy initialization. Snapshot refers to meshes, textures and skybox of the
+ * scene, which must stay alive and unchanged while it is used */
+class CompiledScene
+{
+public:
+	CompiledScene(const Scene& scene, const Options& options, const Camera& camera);
+
+	std::vector<DistantLightRecord> distantLights;
+	std::vector<PointLightRecord> pointLights;
+	std::vector<AreaLightRecord> areaLights;
+	std::vector<Vec3f> areaPoints;
+
+	std::vector<MaterialRecord> materials;
+	std::vector<ObjectRecord> objects;
+
+	CameraBasis camera;
+
+	int skyboxWidth = 0, skyboxHeight = 0;
+	const Vec3f* skyboxes[6] = { nullptr };
+};
@@ -0,0 +1,28 @@
+// Distributed rendering of one frame by several worker processes
+#pragma once
+
+#include <string>
+
+/* Coordinator listens on a Unix domain socket and hands out ranges of tiles to
+ * workers that connect to it. Every worker loads the scene by itself, renders
+ * the tiles of its ranges and streams them back, and coordinator writes them
+ * to the output file. Tiles of a worker that disconnects, or that sends no tile
+ * for the timeout while it has tiles assigned, are given to others.
+ * Messages are binary: header of type and payload size, then the payload:
+ *   Hello      worker -> coordinator: image size, tile size, threads, format, output path
+ *   Assign     coordinator -> worker: tile range [first, last)
+ *   Tile       worker -> coordinator: tile corners followed by its pixels
+ *   RangeDone  worker -> coordinator: all tiles of oldest assigned range were sent
+ *   Finish     coordinator -> worker: image is complete, worker exits
+ * Tiles are numbered row by row like in RenderContext::renderTiles */
+
+// Render scene with given number of local worker processes started by the
+// coordinator, more workers may be started separately with runTileWorker.
+// Program is path of this executable, used if /proc/self/exe is not available.
+// Timeout is in seconds, stalled local workers are killed
+int runCoordinator(const std::string& program, const std::string& scenePath,
+	const std::string& socketPath, size_t localWorkers, size_t timeout);
+
+// Load scene, connect to coordinator and render tiles it assigns until image is
+// finished. Zero threads uses the process-wide pool and n_workers of the scene
+int runTileWorker(const std::string& scenePath, const std::string& socketPath, size_t threads);
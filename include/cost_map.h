@@ -0,0 +1,57 @@
+// Per-pixel render cost, written as false color heatmaps and raw float images
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <chrono>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#include <intrin.h>
+	#define COST_MAP_USE_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+	#include <x86intrin.h>
+	#define COST_MAP_USE_RDTSC
+#endif
+
+#include "options.h"
+
+struct Counters;
+
+/* Workers record cost of every pixel they trace: time stamp counter cycles,
+ * rays and intersection tests. Every pixel is traced by a single worker, so
+ * no synchronization is needed. Without time stamp counter time is in ns */
+class CostMap
+{
+public:
+	CostMap(size_t a_width, size_t a_height);
+
+	// Counter values when pixel was started
+	struct Start
+	{
+		uint64_t cycles;
+		size_t rays, triangleTests, boxTests;
+	};
+
+	static uint64_t cycles()
+	{
+#ifdef COST_MAP_USE_RDTSC
+		return __rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	Start begin(const Counters& counters) const;
+	void end(size_t x, size_t y, const Start& start, const Counters& counters);
+
+	/* Heatmaps <image_name>_cost_<metric> in image format, BMP instead of PFM,
+	 * scaled so that the 99th percentile is the hottest color. Raw values go to
+	 * <image_name>_cost_<metric>.pfm. Returns false if any file could not be written */
+	bool write(const Options& options) const;
+	// Print share of cycles spent in the most costly pixels
+	void report() const;
+
+	const size_t width, height;
+	std::vector<float> cycleCounts, rays, triangleTests, boxTests;
+};
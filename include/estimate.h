@@ -0,0 +1,44 @@
+// Render cost estimate of a loaded scene, made by tracing a small part of its pixels
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+class Scene;
+
+// Bytes a render of the scene needs, by what uses them
+struct MemoryEstimate
+{
+	size_t triangles = 0;	// mesh triangles and their rest poses
+	size_t treeNodes = 0;	// acceleration structures
+	size_t textures = 0;	// texture maps and skybox
+	size_t frameBuffer = 0;	// whole frame, or tile buffers of workers with tiled frame buffer
+
+	size_t total() const { return triangles + treeNodes + textures + frameBuffer; }
+};
+
+struct RenderEstimate
+{
+	size_t sampledPixels = 0;
+	long long sampleTime = 0;	// wall ms spent tracing the sample
+	double cpuTime = 0;	// ms of one core for whole image
+	size_t rays = 0;
+	size_t raysByType[4] = { 0 };	// indexed by RayType
+	MemoryEstimate memory;
+
+	// Wall ms of whole image when every worker has a core of its own
+	double renderTime(size_t workers) const { return cpuTime / (workers ? workers : 1); }
+};
+
+/* One pixel is traced at a random position in every cell of a grid that covers
+ * the image, so that the sample is spread over it evenly. Pixels are rendered
+ * through the same path as in render, with anti-aliasing and all ray types, and
+ * ray counts and time of the sample are scaled to the whole image. Scene options
+ * are not changed */
+RenderEstimate estimateRender(Scene& scene, double fraction = 0.01);
+// Bytes used by loaded scene and buffers of its render
+MemoryEstimate estimateMemory(const Scene& scene);
+
+// Load scene, estimate it and print estimate for given number of workers, n_workers
+// of the scene if it is zero. Animated scene is estimated at its first frame
+int runEstimate(const std::string& scenePath, size_t workers);
@@ -0,0 +1,76 @@
+// Image output: BMP, binary PPM and float PFM, written tile by tile
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <mutex>
+#include <atomic>
+#include <memory>
+
+#include "geometry.h"
+#include "options.h"
+
+/* Writes image directly to its final file. All formats are uncompressed, so
+ * every row has a fixed offset and tiles can be written from any thread in any
+ * order. 8-bit formats are clamped and quantized, PFM keeps HDR values.
+ * On POSIX file is memory-mapped and tiles are quantized straight into it,
+ * elsewhere rows are written through a stream */
+class ImageWriter
+{
+public:
+	ImageWriter(const std::string& a_path, size_t a_width, size_t a_height, ImageFormat a_format);
+	~ImageWriter();
+
+	ImageWriter(const ImageWriter&) = delete;
+	ImageWriter& operator=(const ImageWriter&) = delete;
+
+	bool good() const { return opened; }
+
+	// Write pixels [x0, x1) x [y0, y1), stride is the row length of pixels buffer.
+	// Pixels point to (x0, y0) of that buffer
+	void writeTile(const Vec3f* pixels, size_t stride, size_t x0, size_t y0, size_t x1, size_t y1);
+
+	// Flush and close file, returns false if any write failed
+	bool close();
+
+	static const char* extension(ImageFormat format);
+	// Bytes of pixel rows in file, header is left out
+	static size_t dataSize(size_t width, size_t height, ImageFormat format);
+
+	const std::string path;
+	const size_t width, height;
+	const ImageFormat format;
+
+private:
+	// Byte offset of image row y, rows are counted from the top
+	size_t rowOffset(size_t y) const;
+
+	// Rows [y0, y1) are complete, their pages may be written back and dropped from memory
+	void releaseRows(size_t y0, size_t y1);
+
+	size_t headerSize = 0;
+	size_t rowSize = 0;
+	bool opened = false;
+	bool failed = false;
+#ifdef _WIN32
+	std::ofstream file;
+	std::mutex mutex;
+#else
+	int fd = -1;
+	char* data = nullptr;
+	size_t fileSize = 0;
+	std::unique_ptr<std::atomic<size_t>[]> rowPixels;	// pixels written to every row
+#endif
+};
+
+// Clamp row of pixels to [0, 1] and quantize it to 8-bit RGB, or BGR if bgr is set
+void quantizeRow(const Vec3f* pixels, size_t count, unsigned char* dst, bool bgr);
+
+// Output path built from image name and format extension
+std::string imagePath(const Options& options);
+
+// Write whole frame, rows are converted in parallel
+int saveImage(Vec3f* frameBuffer, const Options& options);
+
+// Open image in default viewer
+void openImage(const std::string& path);
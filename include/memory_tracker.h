@@ -0,0 +1,80 @@
+// Memory used by scene data and render buffers, by category and by asset
+#pragma once
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <cstddef>
+
+// Leaf arrays hold triangle pointers of tree leaves, with the copies of
+// triangles that were put into more than one leaf
+enum class MemoryCategory { Triangles, TreeNodes, LeafArrays, Textures, Skybox, FrameBuffer, OutputBuffer };
+const int memoryCategoryCount = 7;
+
+/* Data is charged to its asset when it is allocated and released when it is
+ * freed. Assets are mesh and texture files, buffers of renders are charged to
+ * "render". Reservation is checked against a budget before memory is allocated,
+ * so that loader fails instead of the process running out of memory */
+class MemoryTracker
+{
+public:
+	// Charge bytes if total usage stays within budget in MB, 0 is no budget.
+	// Otherwise nothing is charged, reason is printed and false is returned
+	bool reserve(MemoryCategory category, const std::string& asset, size_t bytes, size_t budget);
+	// Charge memory that has to be allocated regardless of budget
+	void charge(MemoryCategory category, const std::string& asset, size_t bytes);
+	void release(MemoryCategory category, const std::string& asset, size_t bytes);
+	// Check that current usage fits budget in MB, reason is printed if it does not
+	bool fits(const std::string& asset, size_t budget) const;
+
+	size_t current() const;
+	size_t peak() const;
+	// Print current and peak usage by category, then by asset with the largest first
+	void print(size_t budget) const;
+
+private:
+	struct Usage
+	{
+		size_t current = 0, peak = 0;
+	};
+	struct AssetUsage
+	{
+		Usage total;
+		size_t current[memoryCategoryCount] = { 0 };
+	};
+
+	void add(MemoryCategory category, const std::string& asset, size_t bytes);
+
+	mutable std::mutex mutex;
+	Usage total;
+	Usage categories[memoryCategoryCount];
+	std::map<std::string, AssetUsage> assets;
+};
+
+// Charge of a buffer owned by a scope, released when the scope ends
+class MemoryCharge
+{
+public:
+	MemoryCharge(MemoryTracker& a_tracker, MemoryCategory a_category, const std::string& a_asset)
+		: tracker(a_tracker), category(a_category), asset(a_asset) {}
+	~MemoryCharge() { tracker.release(category, asset, bytes); }
+	MemoryCharge(const MemoryCharge&) = delete;
+	MemoryCharge& operator=(const MemoryCharge&) = delete;
+
+	// Add bytes to charge within budget in MB, 0 charges them unconditionally
+	bool reserve(size_t a_bytes, size_t budget = 0)
+	{
+		if (budget == 0)
+			tracker.charge(category, asset, a_bytes);
+		else if (!tracker.reserve(category, asset, a_bytes, budget))
+			return false;
+		bytes += a_bytes;
+		return true;
+	}
+
+private:
+	MemoryTracker& tracker;
+	const MemoryCategory category;
+	const std::string asset;
+	size_t bytes = 0;
+};
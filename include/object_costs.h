@@ -0,0 +1,49 @@
+// Render cost attributed to objects of the scene and to material types
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+#include "cost_map.h"
+
+struct CompiledScene;
+
+// Work done for one object: intersection tests of all rays against it and
+// shading of hits on its surface
+struct ObjectCost
+{
+	uint64_t intersectCycles = 0, shadeCycles = 0;
+	size_t triangleTests = 0, boxTests = 0;
+	size_t hits = 0;	// closest hits of camera and secondary rays, not shadow rays
+};
+
+/* Costs recorded by one worker, indexed like objects of compiled scene. Running
+ * totals let castRay subtract time of nested traces and shading from its own */
+struct WorkerCosts
+{
+	WorkerCosts(size_t objectCount) : objects(objectCount) {}
+
+	std::vector<ObjectCost> objects;
+	uint64_t traceCycles = 0, shadeCycles = 0;
+};
+
+/* Costs of all workers of a render, time is in time stamp counter cycles like
+ * the cost map. Shading time of a hit excludes rays it spawns, time of shadow
+ * rays goes to the objects they are tested against */
+class ObjectCosts
+{
+public:
+	ObjectCosts(size_t objectCount) : objects(objectCount) {}
+
+	// Merge costs of finished worker, or of another render of the same scene
+	void add(const WorkerCosts& worker);
+	void add(const ObjectCosts& other);
+	// Print objects ranked by total cost, then totals by material type
+	void report(const CompiledScene& scene) const;
+
+	std::vector<ObjectCost> objects;
+
+private:
+	std::mutex mutex;
+};
@@ -1,191 +1,297 @@
-// classes describing object primitives, such as sphere and plane
-#pragma once
-
-#include <vector>
-#include <memory>
-
-class Object;
-class Mesh;
-class AccelerationStructure;
-class Triangle;
-class Sphere;
-class Plane;
-class Triangle;
-
-using ObjectVector = std::vector<std::unique_ptr<Object>>;
-// Object type are stored in base class
-enum class ObjectType { Object, Sphere, Plane, Mesh };
-enum class MaterialType { Diffuse, Reflective, Transparent, Phong };
-
-#include "geometry.h"
-#include "options.h"
-
-// Base object class. Stores position, type, and surface properties
-class Object
-{
-public:
-	Object(const Vec3f& a_center = 1, const Vec3f& a_color = 1,
-		const MaterialType& a_materialType = MaterialType::Diffuse);
-	virtual ~Object();
-	// Checks if ray intersects with object. If it does, return true and  UV coordinate
-	virtual bool intersectObject(const Ray& ray, float& t0, Vec2f& uv) const = 0;
-	// Gets normal and texture in hit point
-	virtual void getSurfaceData(const Vec3f& hitPoint, const Triangle* const triPtr,
-		const Vec2f& uv, Vec3f& hitNormal, Vec2f& tex) const = 0;
-
-	ObjectType objectType = ObjectType::Object;
-
-	Vec3f pos;
-
-	Vec3f color;
-	MaterialType materialType;
-	float indexOfRefraction = 1.4f;
-	float ambient = 0.1f;
-	float diffuse = 0.1f;
-	float specular = 1.0f;
-	float nSpecular = 5.0f;
-};
-
-class Triangle
-{
-public:
-	Triangle(const Vec3f& a_a, const Vec3f& a_b, const Vec3f& a_c);
-	Triangle(const Vec3f& a_a, const Vec3f& a_b, const Vec3f& a_c, 
-		const Vec3f& a_n_a, const Vec3f& a_n_b, const Vec3f& a_n_c);
-	Triangle(const Vec3f& a_a, const Vec3f& a_b, const Vec3f& a_c, 
-		const Vec3f& a_n_a, const Vec3f& a_n_b, const Vec3f& a_n_c,
-		const Vec2f& a_t_a, const Vec2f& a_t_b, const Vec2f& a_t_c);
-	static bool rayTriangleIntersect(const Ray& ray, const Triangle* triPtr,
-		float& t, Vec2f& uv);
-
-	Vec3f a, b, c;			// vertex position
-	Vec3f n_a, n_b, n_c;	// normals in vertices
-	Vec2f t_a, t_b, t_c;	// texture coordinates
-
-	// tangent and bitangent are calculated just once
-	Vec3f tangent, bitangent;
-};
-
-class Mesh : public Object
-{
-public:
-	Mesh();
-	~Mesh();
-
-	bool intersectObject(const Ray& ray, float& t0, Vec2f& uv) const;
-	bool intersectMesh(const Ray& ray, float& t0, const Triangle*& triPtr,
-		Vec2f& uv) const;
-	void getSurfaceData(const Vec3f& hitPoint, const Triangle* const triPtr,
-		const Vec2f& uv, Vec3f& hitNormal, Vec2f& texCoord) const;
-
-	// Get value from map
-	Vec3f getDiffuseColor(const Vec2f& hitTexCoordinates) const;
-	float getSpecularValue(const Vec2f& hitTexCoordinates) const;
-
-	// Loading info
-	bool loadOBJ(const std::string& filename, const Options& options);
-	bool loadDiffuseMap(const std::string& filename);
-	bool loadNormalMap(const std::string& filename);
-	bool loadSpecularMap(const std::string& filename);
-
-	// Objects are normalized upon loading, such as they fit in size 
-	// Proportions are not modified
-	Vec3f size;
-
-	// Also, object may be rotated
-	Vec3f rot;
-	
-	// Save all pointers in one place, to avoid double deletion
-	std::vector<const Triangle*> allTris;
-
-	// Stores triangle, accelerates intersection
-	std::unique_ptr<AccelerationStructure> ac;
-	
-	// Diffuse map stores color
-	bool diffuseMapLoaded = false;
-	int diffuseMapWidth = 0;
-	int diffuseMapHeight = 0;
-	Vec3f* diffuseMap = nullptr;
-
-	// Normal map stores tangent normal
-	bool normalMapLoaded = false;
-	int normalMapWidth = 0;
-	int normalMapHeight = 0;
-	Vec3f* normalMap = nullptr;
-
-	// Specular map stores specular coefficient
-	bool specularMapLoaded = false;
-	int specularMapWidth = 0;
-	int specularMapHeight = 0;
-	float* specularMap = nullptr;
-};
-
-// Acceleration Structure is used to speed up ray-mesh intersection
-class AccelerationStructure
-{
-public:
-	AccelerationStructure();
-	~AccelerationStructure();
-
-	// Set min and max coordinates
-	void setBounds(const Vec3f& a, const Vec3f& b);
-
-	// Create AC tree
-	void setup(std::vector<const Triangle*>& a_tris, int a_depth, const Options& options);
-	
-	// Try intersection
-	bool intersectBox(const Ray& ray) const;
-	
-	// Try intersection with AC mesh
-	bool intersectAccelStruct(const Ray& ray, float& t0, const Triangle*& triPtr, Vec2f& uv) const;
-	
-	// Count intersections AC and sub-AC with ray
-	int recCountAC(const Ray& ray);
-
-	// Calculate SAH - Surface Area Heuristic
-	static float calculateSAH(const int orientation, const std::vector<const Triangle*>& tris,
-		const Vec3f bounds[2], const float boundary);
-
-	// Run binary search to determine optimal split
-	static float binarySearchSAH(const int orientation, const std::vector<const Triangle*>& tris,
-		const Vec3f bounds[2], const float left, const float right);
-	
-	// Get coordinate of optimal split
-	static float getOptimalSplit(const std::vector<const Triangle*>& tris, const int orientation,
-		const Vec3f bounds[2], std::vector<const Triangle*>& trisLeft, std::vector<const Triangle*>& trisRight);
-
-	// Left and Right ancestors
-	std::unique_ptr<AccelerationStructure> left;
-	std::unique_ptr<AccelerationStructure> right;
-	
-	// If AC has no ancestors, it has triangles
-	std::vector<const Triangle*> tris;
-	Vec3f bounds[2];
-};
-
-// Sphere primitive
-class Sphere : public Object
-{
-public:
-	Sphere(const Vec3f& a_center = 0, const float a_r = 1, const Vec3f& a_color = 1,
-		const MaterialType& a_materialType = MaterialType::Diffuse);
-	bool intersectObject(const Ray& ray, float& t0, Vec2f& uv) const;
-	void getSurfaceData(const Vec3f& hitPoint, const Triangle* const triPtr, const Vec2f& uv,
-		Vec3f& hitNormal, Vec2f& tex) const;
-
-	float r;
-	float r2;
-};
-
-// Plane primitive
-class Plane : public Object
-{
-public:
-	Plane(const Vec3f& a_center = 1, const Vec3f& a_normal = { 0, 1, 0 },
-		const Vec3f& a_color = 1, const MaterialType& a_materialType = MaterialType::Diffuse);
-	bool intersectObject(const Ray& ray, float& t0, Vec2f& uv) const;
-	void getSurfaceData(const Vec3f& hitPoint, const Triangle* const triPtr, const Vec2f& uv,
-		Vec3f& hitNormal, Vec2f& tex) const;
-
-	Vec3f normal;
-};
+// classes describing object primitives, such as sphere and plane
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
+
+class Object;
+class Mesh;
+class MeshGeometry;
+class AccelerationStructure;
+class Triangle;
+class Sphere;
+class Plane;
+class Triangle;
+class Stats;
+struct TreeShape;
+class ThreadPool;
+
+using ObjectVector = std::vector<std::unique_ptr<Object>>;
+// Object type are stored in base class
+enum class ObjectType { Object, Sphere, Plane, Mesh };
+enum class MaterialType { Diffuse, Reflective, Transparent, Phong };
+
+#include "geometry.h"
+#include "options.h"
+
+// Base object class. Stores position, type, and surface properties
+class Object
+{
+public:
+	Object(const Vec3f& a_center = 1, const Vec3f& a_color = 1,
+		const MaterialType& a_materialType = MaterialType::Diffuse);
+	virtual ~Object();
+	// Checks if ray intersects with object. If it does, return true and  UV coordinate
+	virtual bool intersectObject(const Ray& ray, float& t0, Vec2f& uv) const = 0;
+	// Gets normal and texture in hit point
+	virtual void getSurfaceData(const Vec3f& hitPoint, const Triangle* const triPtr,
+		const Vec2f& uv, Vec3f& hitNormal, Vec2f& tex) const = 0;
+
+	ObjectType objectType = ObjectType::Object;
+
+	Vec3f pos;
+
+	Vec3f color;
+	MaterialType materialType;
+	float indexOfRefraction = 1.4f;
+	float ambient = 0.1f;
+	float diffuse = 0.1f;
+	float specular = 1.0f;
+	float nSpecular = 5.0f;
+};
+
+class Triangle
+{
+public:
+	Triangle(const Vec3f& a_a, const Vec3f& a_b, const Vec3f& a_c);
+	Triangle(const Vec3f& a_a, const Vec3f& a_b, const Vec3f& a_c, 
+		const Vec3f& a_n_a, const Vec3f& a_n_b, const Vec3f& a_n_c);
+	Triangle(const Vec3f& a_a, const Vec3f& a_b, const Vec3f& a_c, 
+		const Vec3f& a_n_a, const Vec3f& a_n_b, const Vec3f& a_n_c,
+		const Vec2f& a_t_a, const Vec2f& a_t_b, const Vec2f& a_t_c);
+	static bool rayTriangleIntersect(const Ray& ray, const Triangle* triPtr,
+		float& t, Vec2f& uv, TraceState& state);
+
+	Vec3f a, b, c;			// vertex position
+	Vec3f n_a, n_b, n_c;	// normals in vertices
+	Vec2f t_a, t_b, t_c;	// texture coordinates
+
+	// tangent and bitangent are calculated just once
+	Vec3f tangent, bitangent;
+};
+
+// Texture map, texels are stored row by row. Loaded maps are never changed,
+// so meshes may share them
+template<typename T>
+struct TextureMap
+{
+	int width = 0, height = 0;
+	std::vector<T> texels;
+
+	// Texel at texture coordinate, coordinates past 1 get the last texel
+	const T& at(const Vec2f& texCoord) const
+	{
+		const int x = std::min((int)(width * texCoord.x), width - 1);
+		const int y = std::min((int)(height * texCoord.y), height - 1);
+		return texels[y * (size_t)width + x];
+	}
+
+	size_t memorySize() const { return sizeof(*this) + texels.size() * sizeof(T); }
+};
+
+class Mesh : public Object
+{
+public:
+	Mesh();
+	~Mesh();
+
+	bool intersectObject(const Ray& ray, float& t0, Vec2f& uv) const;
+	bool intersectMesh(const Ray& ray, float& t0, const Triangle*& triPtr,
+		Vec2f& uv, TraceState& state) const;
+	void getSurfaceData(const Vec3f& hitPoint, const Triangle* const triPtr,
+		const Vec2f& uv, Vec3f& hitNormal, Vec2f& texCoord) const;
+
+	// Get value from map
+	Vec3f getDiffuseColor(const Vec2f& hitTexCoordinates) const;
+	float getSpecularValue(const Vec2f& hitTexCoordinates) const;
+
+	// Loading info
+	bool loadOBJ(const std::string& filename, const Options& options, Stats& stats);
+	// Build mesh from arrays in world space, every three indices form a triangle.
+	// Normals and texture coordinates are optional and use the same indices
+	bool loadTriangles(const std::vector<Vec3f>& vertices, const std::vector<uint32_t>& indices,
+		const Options& options, Stats& stats, const std::vector<Vec3f>& normals = {},
+		const std::vector<Vec2f>& texCoords = {});
+	// Take ownership of triangles and build acceleration structure over them, bounds
+	// of acceleration structure have to enclose all triangles. Triangles have to be
+	// charged to memory already, returns false and drops them if tree goes over budget
+	bool setTriangles(std::vector<const Triangle*>& tris, const Vec3f& min, const Vec3f& max,
+		const Options& options, Stats& stats);
+	// Move mesh rigidly from the pose it was loaded in to new position and rotation.
+	// Acceleration structure is moved along when only position changes, otherwise refitted.
+	// Geometry shared with other meshes is copied first
+	void setTransform(const Vec3f& newPos, const Vec3f& newRot, const Options& options, Stats& stats,
+		ThreadPool& pool);
+	// Refit acceleration structure after triangles were moved or deformed in place. Tree is
+	// built again once its SAH cost grows past acRebuildThreshold times cost of a fresh tree
+	void refit(const Options& options, Stats& stats, ThreadPool& pool);
+	// Texture map loaders, return nullptr if file could not be loaded
+	static std::shared_ptr<TextureMap<Vec3f>> loadDiffuseMap(const std::string& filename);
+	static std::shared_ptr<TextureMap<Vec3f>> loadNormalMap(const std::string& filename);
+	static std::shared_ptr<TextureMap<float>> loadSpecularMap(const std::string& filename);
+
+	// Objects are normalized upon loading, such as they fit in size 
+	// Proportions are not modified
+	Vec3f size;
+
+	// Also, object may be rotated
+	Vec3f rot;
+
+	// File mesh was loaded from, shown in reports and charged for its memory
+	std::string name;
+	
+	// Triangles and acceleration structure, may be shared with other meshes
+	std::shared_ptr<MeshGeometry> geometry;
+
+	// Triangles in the pose mesh was loaded in, copied when mesh is moved for the first time
+	std::vector<Triangle> restTris;
+	Vec3f restPos, restRot;
+
+	// Texture maps, nullptr if not loaded. Maps may be shared with other meshes
+	std::shared_ptr<const TextureMap<Vec3f>> diffuseMap;	// color
+	std::shared_ptr<const TextureMap<Vec3f>> normalMap;	// tangent normal
+	std::shared_ptr<const TextureMap<float>> specularMap;	// specular coefficient
+};
+
+/* Triangles of a mesh and acceleration structure built over them. Loaded
+ * geometry may be shared by meshes of different scenes, it is changed only by
+ * its single owner */
+class MeshGeometry
+{
+public:
+	MeshGeometry();
+	~MeshGeometry();
+	MeshGeometry(const MeshGeometry&) = delete;
+	MeshGeometry& operator=(const MeshGeometry&) = delete;
+
+	// Build acceleration structure over all triangles, within given bounds. Memory
+	// of previous tree is released and the new one is charged
+	void buildAC(const Vec3f& min, const Vec3f& max, const Options& options, Stats& stats);
+	// Release memory charged for triangles and tree
+	void releaseMemory(Stats& stats);
+	// Charge triangles and tree to another scene sharing this geometry, within
+	// budget in MB. Nothing is charged if they do not fit
+	bool reserveMemory(Stats& stats, size_t budget) const;
+	// Deep copy, tree is copied as it is instead of being built again
+	std::shared_ptr<MeshGeometry> copy() const;
+	// Bytes used by triangles and acceleration structure
+	size_t memorySize() const;
+
+	// Save all pointers in one place, to avoid double deletion
+	std::vector<const Triangle*> tris;
+
+	// Stores triangle, accelerates intersection
+	std::unique_ptr<AccelerationStructure> ac;
+	float acBaseCost = 0;	// relative SAH cost of acceleration structure when it was built
+
+	// Asset memory is charged to, and bytes of tree charged so far
+	std::string name;
+	size_t nodeBytes = 0, leafBytes = 0;
+};
+
+// Bytes charged for every triangle of a mesh, with its pointer
+const size_t triangleMemory = sizeof(Triangle) + sizeof(const Triangle*);
+
+// Acceleration Structure is used to speed up ray-mesh intersection
+class AccelerationStructure
+{
+public:
+	AccelerationStructure();
+	~AccelerationStructure();
+
+	// Set min and max coordinates
+	void setBounds(const Vec3f& a, const Vec3f& b);
+
+	// Move bounds of the whole tree, after all triangles were moved by offset
+	void translate(const Vec3f& offset);
+
+	// Tight bounds of subtree and its SAH cost, node bounds are changed only when update is set
+	float fit(Vec3f box[2], const bool update);
+
+	// Copy of the tree, triangle pointers are replaced with their copies from remap
+	std::unique_ptr<AccelerationStructure> copy(
+		const std::unordered_map<const Triangle*, const Triangle*>& remap) const;
+	// Bytes used by the tree
+	size_t memorySize() const;
+	// Add nodes and leaves of the tree to shape statistics, depth is depth of this node
+	void addShape(TreeShape& shape, size_t depth = 0) const;
+
+	// Recompute bounds bottom-up from current triangles, splits are kept. Subtrees are
+	// refitted as pool tasks, so it must not be called from a task of the same pool.
+	// Returns SAH cost relative to root surface area
+	float refit(ThreadPool& pool);
+
+	// Create AC tree
+	void setup(std::vector<const Triangle*>& a_tris, int a_depth, const Options& options, Stats& stats);
+	
+	// Try intersection
+	bool intersectBox(const Ray& ray, TraceState& state) const;
+	
+	// Try intersection with AC mesh
+	bool intersectAccelStruct(const Ray& ray, float& t0, const Triangle*& triPtr, Vec2f& uv,
+		TraceState& state) const;
+	
+	// Count intersections AC and sub-AC with ray
+	int recCountAC(const Ray& ray, TraceState& state) const;
+
+	// Calculate SAH - Surface Area Heuristic
+	static float calculateSAH(const int orientation, const std::vector<const Triangle*>& tris,
+		const Vec3f bounds[2], const float boundary);
+
+	// Run binary search to determine optimal split
+	static float binarySearchSAH(const int orientation, const std::vector<const Triangle*>& tris,
+		const Vec3f bounds[2], const float left, const float right);
+	
+	// Get coordinate of optimal split
+	static float getOptimalSplit(const std::vector<const Triangle*>& tris, const int orientation,
+		const Vec3f bounds[2], std::vector<const Triangle*>& trisLeft, std::vector<const Triangle*>& trisRight);
+
+	// Left and Right ancestors
+	std::unique_ptr<AccelerationStructure> left;
+	std::unique_ptr<AccelerationStructure> right;
+	
+	// If AC has no ancestors, it has triangles
+	std::vector<const Triangle*> tris;
+	Vec3f bounds[2];
+
+private:
+	// Nodes at given depth, or leaves above it, in left to right order
+	void collectSubtrees(int depth, std::vector<AccelerationStructure*>& subtrees);
+	// Refit nodes above given depth from costs of already refitted subtrees
+	float fitAbove(int depth, const std::vector<float>& costs, size_t& next);
+};
+
+// Sphere primitive
+class Sphere : public Object
+{
+public:
+	Sphere(const Vec3f& a_center = 0, const float a_r = 1, const Vec3f& a_color = 1,
+		const MaterialType& a_materialType = MaterialType::Diffuse);
+	bool intersectObject(const Ray& ray, float& t0, Vec2f& uv) const;
+	void getSurfaceData(const Vec3f& hitPoint, const Triangle* const triPtr, const Vec2f& uv,
+		Vec3f& hitNormal, Vec2f& tex) const;
+
+	// Intersect sphere given by center and squared radius
+	static bool intersect(const Ray& ray, const Vec3f& pos, const float r2, float& t0);
+
+	float r;
+	float r2;
+};
+
+// Plane primitive
+class Plane : public Object
+{
+public:
+	Plane(const Vec3f& a_center = 1, const Vec3f& a_normal = { 0, 1, 0 },
+		const Vec3f& a_color = 1, const MaterialType& a_materialType = MaterialType::Diffuse);
+	bool intersectObject(const Ray& ray, float& t0, Vec2f& uv) const;
+	void getSurfaceData(const Vec3f& hitPoint, const Triangle* const triPtr, const Vec2f& uv,
+		Vec3f& hitNormal, Vec2f& tex) const;
+
+	// Intersect plane going through pos with given unit normal
+	static bool intersect(const Ray& ray, const Vec3f& pos, const Vec3f& normal, float& t0);
+
+	Vec3f normal;
+};
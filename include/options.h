@@ -1,36 +1,94 @@
-// Class describing options, and namespace for global setting
-#pragma once
-
-#include <filesystem>
-#include <string>
-
-#include "geometry.h"
-
-class Options
-{
-public:
-	size_t width = 800, height = 600;		// screen dimensions in pixels
-	float bias = 0.0001f;	// bias is used to avoid self-intersections
-	int maxRayDepth = 5;
-	int nWorkers = 8;
-	Vec3f backgroundColor { 0.0f, 0.0f, 0.0f };
-	int acPenalty = 1;	// determines amount of acceleration structures
-	char names[6][64] = { { 0 } };	// skybox names
-	std::string imageName = "out";
-};
-
-
-namespace options
-{
-	// global settings
-	inline bool outputProgress			= 1;
-	inline bool useBackfaceCulling		= 1;
-	inline bool collectStatistics		= 0;
-	inline bool enableOutput			= 1;
-	inline bool imageOutput				= 1;
-	inline bool useAC					= 1;
-	inline bool showAC					= 0;
-	inline bool useSkybox				= 0;
-	inline bool useTextures				= 1;
-	inline bool showNormals				= 0;
-}
+// Class describing scene options, and state passed to intersection routines
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <cstdint>
+
+#include "geometry.h"
+#include "sampler.h"
+
+// Reconstruction filter used by anti-aliasing
+enum class FilterType { Box, Tent, Gaussian };
+
+// Format of output image, PFM keeps unclamped floats
+enum class ImageFormat { BMP, PPM, PFM };
+
+/* All settings of a scene. Every render works on its own frozen copy, so
+ * scenes rendered at the same time never share any settings */
+class Options
+{
+public:
+	// Behavior flags
+	bool outputProgress		= 1;
+	bool useBackfaceCulling	= 1;
+	bool collectStatistics	= 0;
+	bool enableOutput		= 1;
+	bool imageOutput		= 1;
+	bool openImage			= 0;	// show finished image in default viewer
+	bool useAC				= 1;
+	bool showAC				= 0;
+	bool useSkybox			= 0;
+	bool useTextures		= 1;
+	bool showNormals		= 0;
+	bool progressive		= 0;
+	bool antialiasing		= 0;
+	bool tiledFramebuffer	= 0;	// keep only tiles in flight in memory
+	bool checkpoint			= 0;	// log finished tiles, so that stopped render can be resumed
+	bool resume				= 0;	// skip tiles found in checkpoint of previous render
+	bool costMap			= 0;	// record cost of every pixel and write it as heatmaps
+	bool objectCosts		= 0;	// attribute intersection and shading time to objects and materials
+	bool perfCounters		= 0;	// count hardware events of load, build and render on every thread
+	bool memoryReport		= 0;	// print memory used by categories and assets after render
+
+	size_t width = 800, height = 600;		// screen dimensions in pixels
+	float bias = 0.0001f;	// bias is used to avoid self-intersections
+	int maxRayDepth = 5;
+	int nWorkers = 8;
+	Vec3f backgroundColor { 0.0f, 0.0f, 0.0f };
+	int acPenalty = 1;	// determines amount of acceleration structures
+	float acRebuildThreshold = 1.5f;	// refitted tree is rebuilt when its SAH cost grows by this factor
+	int progressiveStep = 8;	// distance between pixels traced in first progressive pass
+	int progressiveInterval = 2000;	// minimal time between intermediate images in ms
+	int checkpointInterval = 10000;	// minimal time between checkpoint flushes in ms
+	int timeBudget = 0;	// target render time in ms, quality is lowered to meet it, 0 is off
+	size_t memoryBudget = 0;	// MB of scene data and render buffers, loads that would exceed it fail, 0 is off
+	int aaMinSamples = 4;	// samples traced through every anti-aliased pixel
+	int aaMaxSamples = 16;	// limit of samples for pixels with high variance
+	float aaThreshold = 0.01f;	// allowed standard error of pixel luminance
+	FilterType aaFilter = FilterType::Box;
+	float aaFilterWidth = 1.0f;	// filter support in pixels
+	SamplerType samplerType = SamplerType::Sobol;
+	ImageFormat imageFormat = ImageFormat::BMP;
+	int tileSize = 32;	// edge of square tiles rendered and written by workers
+	char names[6][64] = { { 0 } };	// skybox names
+	std::string imageName = "out";
+};
+
+
+struct Counters;
+struct WorkerCosts;
+
+// Quality settings a worker traces with, time budget may lower them tile by tile
+struct Quality
+{
+	Quality(const Options& options)
+		: maxRayDepth(options.maxRayDepth), antialiasing(options.antialiasing), aaMaxSamples(options.aaMaxSamples) {}
+
+	int maxRayDepth;
+	uint32_t areaLightSamples = UINT32_MAX;	// limit of shadow rays per area light
+	bool antialiasing;
+	int aaMaxSamples;
+};
+
+// Passed down to intersection routines by every worker: frozen options of the
+// render and counters owned by the worker, so that nothing is shared between threads
+struct TraceState
+{
+	const Options& options;
+	Counters& counters;
+	Quality quality;
+	bool countTests = false;	// rays and intersection tests are counted, for statistics or cost maps
+	int depth = 0;	// recursion depth of ray being traced, for statistics
+	WorkerCosts* objectCosts = nullptr;	// set when costs are attributed to objects
+};
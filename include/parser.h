@@ -0,0 +1,87 @@
+// Single pass scene file parser
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <cstdint>
+
+class Scene;
+class ThreadPool;
+class Light;
+class Object;
+
+#include "geometry.h"
+
+// FNV-1a hash, used to dispatch keys with a switch instead of string comparisons
+constexpr uint64_t hashKey(std::string_view key)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (char c : key) {
+		hash ^= (uint8_t)c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Error with exact position in scene file, positions start from 1
+class ParseError : public std::runtime_error
+{
+public:
+	ParseError(const std::string& message, size_t a_line, size_t a_column);
+
+	size_t line;
+	size_t column;
+};
+
+/* Parses memory-mapped scene file in one pass. Keys and values are views of
+ * the mapped file, numbers are read with from_chars, so nothing is allocated
+ * per line. Assets are scheduled on loaders pool and recorded in pendingLoads */
+class SceneParser
+{
+public:
+	SceneParser(Scene& a_scene, ThreadPool& a_loaders, std::vector<std::future<bool>>& a_pendingLoads);
+
+	// Parse scene file, on error print its position and return false
+	bool parse(const std::string& scenePath);
+	// Parse text of scene file, name is used in error messages
+	bool parseText(std::string_view text, const std::string& name);
+
+private:
+	enum class BlockType { None, Options, Light, Object, Animation };
+
+	void parseLines(std::string_view text);
+	void selectBlock(std::string_view header);
+	void finishBlock();
+	void parseOption(std::string_view key, std::string_view value);
+	void parseLight(std::string_view key, std::string_view value);
+	void parseObject(std::string_view key, std::string_view value);
+	void parseAnimation(std::string_view key, std::string_view value);
+
+	// Value readers, throw ParseError pointing to the value
+	bool toBool(std::string_view value) const;
+	int toInt(std::string_view value) const;
+	float toFloat(std::string_view value) const;
+	Vec3f toVec3(std::string_view value) const;
+	// Frame number followed by 3 comma separated numbers
+	int toKeyframe(std::string_view value, Vec3f& result) const;
+	[[noreturn]] void error(const std::string& message, std::string_view at) const;
+
+	Scene& scene;
+	ThreadPool& loaders;
+	std::vector<std::future<bool>>& pendingLoads;
+
+	// Entity of the current block, moved to scene when block is finished
+	BlockType blockType = BlockType::None;
+	std::unique_ptr<Light> light;
+	std::unique_ptr<Object> object;
+	std::string meshPath;
+	size_t blockLineNumber = 0;
+
+	// Current position, used for error messages
+	const char* lineStart = nullptr;
+	size_t lineNumber = 0;
+};
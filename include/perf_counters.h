@@ -0,0 +1,51 @@
+// Hardware performance counters of the calling thread, read through Linux perf_event_open
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+class Stats;
+
+// Phases counters are summed over. Load covers whole OBJ loading, including the
+// tree build, which is also counted on its own
+enum class PerfPhase { Load, Build, Render };
+const int perfPhaseCount = 3;
+
+// Cycles, instructions, last level cache misses, branch misses and task clock in ns
+const int perfEventCount = 5;
+
+struct PerfValues
+{
+	uint64_t values[perfEventCount] = { 0 };
+};
+
+/* Every thread opens its counters the first time it reads them and keeps them
+ * until it exits. Only user space of the calling thread is counted. Events the
+ * CPU or kernel does not provide are left out, and on other systems than Linux
+ * nothing is counted */
+class PerfCounters
+{
+public:
+	// Read counters of calling thread, values of multiplexed events are scaled to the
+	// whole time they were enabled. Returns mask of events that could be read
+	static unsigned read(PerfValues& values);
+	static const char* eventName(int event);
+	// Reason why events could not be opened, empty if all were
+	static std::string error();
+};
+
+// Adds events counted by calling thread within its scope to a phase of statistics
+class PerfScope
+{
+public:
+	PerfScope(Stats& a_stats, PerfPhase a_phase, bool enabled);
+	~PerfScope();
+	PerfScope(const PerfScope&) = delete;
+	PerfScope& operator=(const PerfScope&) = delete;
+
+private:
+	Stats* const stats;
+	const PerfPhase phase;
+	PerfValues start;
+	unsigned events = 0;
+};
@@ -0,0 +1,50 @@
+// Scoped zone profiler, compiled in only when RT_PROFILE is defined
+#pragma once
+
+/* PROFILE_ZONE("name") times the rest of its scope on the calling thread. Zones
+ * nest, and every thread records finished zones into its own ring buffer, so the
+ * oldest zones are overwritten once a thread has recorded more than the buffer holds.
+ * At exit the zones of all threads are written as Chrome trace_event JSON to
+ * the file named by RT_PROFILE_TRACE, profile.json by default. Trace is opened
+ * in chrome://tracing or Perfetto, and a summary of zones by their nesting is
+ * printed. Names have to be string literals. Without RT_PROFILE the macros
+ * expand to nothing */
+#ifdef RT_PROFILE
+
+#include <cstdint>
+#include <string>
+
+namespace profiler
+{
+	// Name shown for calling thread in trace and summary
+	void setThreadName(const char* name);
+	// Write trace of all zones recorded so far, returns false if file could not be written
+	bool writeTrace(const std::string& path);
+	// Print time of zones by nesting, summed over threads, and busy time of every thread
+	void printSummary();
+
+	class Zone
+	{
+	public:
+		explicit Zone(const char* a_name);
+		~Zone();
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+
+	private:
+		const char* name;
+		uint64_t start;
+	};
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) profiler::Zone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_THREAD(name) profiler::setThreadName(name)
+
+#else
+
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+
+#endif
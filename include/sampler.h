@@ -0,0 +1,60 @@
+// Low-discrepancy samplers, used by anti-aliasing and area lights
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "geometry.h"
+
+/* Regular - same grid in every pixel (area lights keep their fixed points)
+ * R2 - additive recurrence, shifted by white noise per pixel
+ * Sobol - Owen-scrambled Sobol (0,2)-sequence, scrambled per pixel
+ * BlueNoise - R2 sequence, shifted per pixel by blue noise tables, so that
+ * remaining error is distributed as high frequency noise over the image */
+enum class SamplerType { Regular, R2, Sobol, BlueNoise };
+
+// Produces deterministic 2D sample sets. Set is identified by pixel, pixel
+// sample and dimension, the same set always contains the same points
+class Sampler
+{
+public:
+	Sampler(const SamplerType a_type = SamplerType::Sobol);
+
+	// Get index-th point of set, in [0, 1)^2
+	Vec2f get2D(uint32_t index, uint32_t x, uint32_t y, uint32_t sample, uint32_t dimension) const;
+
+	SamplerType type;
+
+private:
+	// Blue noise tables are shared by all samplers and built on first use
+	static const std::vector<float>& blueNoiseTable(int channel);
+	static std::vector<float> buildBlueNoise(uint32_t seed);
+
+	Vec2f getSobol(uint32_t index, uint32_t seed) const;
+	Vec2f getR2(uint32_t index, float shiftX, float shiftY) const;
+};
+
+// Sampling state of one pixel. Dimensions are taken in the order of use along
+// the ray tree, which keeps results reproducible for every pixel
+class PixelSampler
+{
+public:
+	PixelSampler(const Sampler& a_sampler, uint32_t a_x, uint32_t a_y);
+
+	// Offset of n-th pixel sample inside pixel, in [0, 1)^2
+	Vec2f pixelOffset(uint32_t n) const;
+
+	// Start n-th pixel sample, each one uses its own sets of dimensions
+	void startSample(uint32_t n);
+
+	// Reserve next dimension, its points are then taken with get2D
+	uint32_t nextDimension();
+	Vec2f get2D(uint32_t index, uint32_t dimension) const;
+
+	const Sampler& sampler;
+
+private:
+	uint32_t x, y;
+	uint32_t sample = 0;
+	uint32_t dimension = 0;
+};
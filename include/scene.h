@@ -1,91 +1,213 @@
-// classed describing scene and camera
-#pragma once
-
-struct IntersectInfo;
-class Render;
-class Camera;
-class Scene;
-
-#include <atomic>
-
-#include "geometry.h"
-#include "objects.h"
-#include "lights.h"
-#include "options.h"
-
-// Store all intersect info in one structure to reduce number of parameters
-struct IntersectInfo
-{
-	const Object* hitObject = nullptr;
-	float tNear = std::numeric_limits<float>::max();
-	const Triangle* triPtr = nullptr;
-	Vec2f uv{ -1,-1 };
-};
-
-// Some static functions
-class Render
-{
-public:
-	// Get reflected ray
-	static Vec3f reflect(const Vec3f& dir, const Vec3f& normal);
-	
-	// Get refracted ray
-	static Vec3f refract(const Vec3f& dir, const Vec3f& normal, const float& indexOfRefraction);
-	
-	// Get Fresnel coefficient
-	static float fresnel(const Vec3f& dir, const Vec3f& normal, const float& indexOfRefraction);
-
-	// Check if anything intersects with the ray
-	static bool trace(const Ray& ray, const ObjectVector& objects, IntersectInfo& intrInfo);
-
-	// Cast ray
-	static Vec3f castRay(const Ray& ray, const Scene& scene, const int depth);
-};
-
-// Stores all camera info
-class Camera
-{
-public:
-	Vec3f pos;
-	Vec3f rot;
-	Matrix44f rMatrix;
-
-	float fov = 60.0f;
-	float zNear = 0.1f, zFar = 100.0f;
-
-	Camera(const Vec3f& a_pos = { 0, 0, 0 }, const Vec3f& a_rot = { 0, 0, 0 });
-	Ray getRay(const float xPix, const  float yPix);
-
-	bool cameraRotated = false;
-};
-
-// Stores scene info
-class Scene
-{
-public:
-	bool sceneLoadSuccess = true;
-
-	ObjectVector objects;
-	LightsVector lights;
-	Options options;
-	Camera camera;
-
-	// Skybox info
-	int skyboxWidth, skyboxHeight;
-	Vec3f* skyboxes[6] = { nullptr };
-
-	// Info for statistics
-	std::atomic<int> finishedPixels{ 0 };
-	std::atomic<int> finishedWorkers{ 0 };
-
-	Scene(const std::string& sceneName);
-	bool loadScene(const std::string& sceneName);
-	void loadSkybox();
-	Vec3f getSkybox(const Vec3f& dir) const;
-
-	long long render();
-	int launchWorkers(Vec3f* frameBuffer);
-	void renderWorker(Vec3f* frameBuffer, size_t y0, size_t y1);
-
-	int countAC(const Ray& ray);
-};
+// classed describing scene and camera
+#pragma once
+
+struct IntersectInfo;
+class Render;
+class Camera;
+class Scene;
+class RenderContext;
+class ThreadPool;
+class AssetCache;
+class SceneParser;
+
+#include <atomic>
+#include <functional>
+#include <string_view>
+
+#include "geometry.h"
+#include "objects.h"
+#include "lights.h"
+#include "options.h"
+#include "sampler.h"
+#include "stats.h"
+#include "compiled_scene.h"
+#include "animation.h"
+#include "cost_map.h"
+#include "object_costs.h"
+
+// Store all intersect info in one structure to reduce number of parameters
+struct IntersectInfo
+{
+	const ObjectRecord* hitObject = nullptr;
+	float tNear = std::numeric_limits<float>::max();
+	const Triangle* triPtr = nullptr;
+	Vec2f uv{ -1,-1 };
+};
+
+// Some static functions
+class Render
+{
+public:
+	// Get reflected ray
+	static Vec3f reflect(const Vec3f& dir, const Vec3f& normal);
+	
+	// Get refracted ray
+	static Vec3f refract(const Vec3f& dir, const Vec3f& normal, const float& indexOfRefraction);
+	
+	// Get Fresnel coefficient
+	static float fresnel(const Vec3f& dir, const Vec3f& normal, const float& indexOfRefraction);
+
+	// Check if anything intersects with the ray
+	static bool trace(const Ray& ray, const CompiledScene& scene, IntersectInfo& intrInfo, TraceState& state);
+
+	// Cast ray
+	static Vec3f castRay(const Ray& ray, const RenderContext& ctx, const int depth, PixelSampler& sampler,
+		TraceState& state);
+
+	// Sum light of all visible sources at hit point. Diffuse part is weighted by
+	// cosine, specular part is the Phong term, only parts used by material are computed
+	static void gatherLight(const RenderContext& ctx, const Vec3f& hitPoint, const Vec3f& hitNormal,
+		const Vec3f& viewDir, const MaterialRecord& material, PixelSampler& sampler, TraceState& state,
+		Vec3f& diffuse, Vec3f& specular);
+};
+
+// Stores all camera info
+class Camera
+{
+public:
+	Vec3f pos;
+	Vec3f rot;
+	Matrix44f rMatrix;
+
+	float fov = 60.0f;
+	float zNear = 0.1f, zFar = 100.0f;
+
+	Camera(const Vec3f& a_pos = { 0, 0, 0 }, const Vec3f& a_rot = { 0, 0, 0 });
+	// Build rotation matrix from rot, has to be called after camera is moved
+	Camera& update();
+	Ray getRay(const float xPix, const  float yPix) const;
+};
+
+// Receives finished tile [x0, x1) x [y0, y1) of the image. Pixels point to
+// (x0, y0) and rows are stride pixels apart. Called from worker threads
+using TileCallback = std::function<void(const Vec3f* pixels, size_t stride,
+	size_t x0, size_t y0, size_t x1, size_t y1)>;
+
+// Receives finished part of render in percent, about once a second. Called from
+// the thread that started the render
+using ProgressCallback = std::function<void(float percent)>;
+
+/* Stores scene info. Scene is either loaded from scene file, or built in memory
+ * with addObject and addLight, options and camera are set directly. Loaded
+ * scene may be rendered many times, e.g. with different camera, and separate
+ * scenes may be rendered at the same time from different threads */
+class Scene
+{
+public:
+	bool sceneLoadSuccess = true;
+	std::string loadError;	// reason of last failed load
+	uint64_t sourceHash = 0;	// hash of scene text, 0 for scene built in memory
+
+	ObjectVector objects;
+	LightsVector lights;
+	Options options;
+	Camera camera;
+	Stats stats;
+	Animation animation;
+
+	// Pool used for loading and rendering, process-wide pool if not set
+	ThreadPool* pool = nullptr;
+	// Meshes and textures are taken from cache and stored in it, if it is set
+	AssetCache* assets = nullptr;
+	ProgressCallback onProgress;
+	// Tiled render stops taking new tiles once this is set, e.g. by signal handler
+	const std::atomic<bool>* stop = nullptr;
+
+	// Skybox info
+	int skyboxWidth, skyboxHeight;
+	Vec3f* skyboxes[6] = { nullptr };
+
+	Scene();
+	Scene(const std::string& sceneName);
+	~Scene();
+	Scene(const Scene&) = delete;
+	Scene& operator=(const Scene&) = delete;
+
+	bool loadScene(const std::string& sceneName);
+	// Load scene from text of scene file, name is used in messages
+	bool loadSceneText(std::string_view text, const std::string& name);
+	bool loadSkybox(ThreadPool& loaders);
+
+	// Add entities to scene, meshes have to be loaded already
+	void addObject(std::unique_ptr<Object> object);
+	void addLight(std::unique_ptr<Light> light);
+
+	// Render and write image as set in options, print statistics. Returns render
+	// time in ms or -1 if scene was not loaded or render was stopped
+	long long render();
+	// Render into caller buffer of width * height pixels, nothing is written to disk
+	long long render(Vec3f* frameBuffer);
+	// Render tile by tile without frame buffer, progressive mode and showAC are ignored
+	long long render(const TileCallback& onTile);
+
+	// Move camera and keyed objects to their pose at given frame of animation
+	void setFrame(int frame);
+	// Render all frames of animation, frame is written as <image_name>_<frame> while
+	// the next one is rendered. Returns render time in ms or -1 if scene was not loaded
+	long long renderAnimation();
+
+	ThreadPool& workerPool() const;
+	// Shape of acceleration structures of all meshes
+	TreeShape treeShape() const;
+
+private:
+	// Run parser and wait for all assets it scheduled
+	bool loadAssets(const std::string& name, const std::function<bool(SceneParser&)>& parse);
+	// Print statistics and write them to <image_name>_stats.json
+	void reportStatistics(const Options& settings) const;
+};
+
+/* Frozen state of one render, shared by all its workers. Options are copied
+ * and scene is compiled when render starts, so workers never read anything that
+ * may be changed from outside. Apart from statistics, which workers merge once
+ * they finish, progress counter is the only thing written during render */
+class RenderContext
+{
+public:
+	RenderContext(Scene& a_scene);
+
+	const Options options;
+	const Sampler sampler;
+	const CompiledScene compiled;
+	Stats& stats;
+	ThreadPool& pool;
+	const ProgressCallback onProgress;
+	const std::atomic<bool>* const stop;
+
+	std::atomic<size_t> finishedPixels{ 0 };
+	// Tiles restored from checkpoint, set before render and not rendered again
+	std::vector<char> skipTiles;
+	// Cost of every traced pixel, set when cost map is enabled
+	std::unique_ptr<CostMap> costs;
+	// Cost of every object, set when object costs are enabled
+	std::unique_ptr<ObjectCosts> objectCosts;
+
+	Vec3f getSkybox(const Vec3f& dir) const;
+
+	// Run work(workerIndex, state) on every worker and print progress until all finish
+	void launchWorkers(const std::function<void(size_t, TraceState&)>& work);
+	// Render whole frame in mode set by options
+	void renderFrame(Vec3f* frameBuffer);
+	// Render tiles [firstTile, lastTile) of image, tiles are numbered row by row. Finished
+	// tiles are passed to onTile if it is set. Without frame buffer pixels exist only
+	// in tile buffers and the callback. Returns false if render was stopped
+	bool renderTiles(Vec3f* frameBuffer, const TileCallback& onTile, size_t firstTile = 0,
+		size_t lastTile = std::numeric_limits<size_t>::max());
+	size_t tileCount() const;
+	// Pixels [x0, x1) x [y0, y1) covered by tile
+	void tileRect(size_t tile, size_t& x0, size_t& y0, size_t& x1, size_t& y1) const;
+	// Show number of acceleration structures hit by primary rays
+	void renderAC(Vec3f* frameBuffer);
+	Vec3f renderPixel(size_t x, size_t y, TraceState& state) const;
+	// Trace one camera ray through given point of image plane, in pixels
+	Vec3f traceSample(float x, float y, PixelSampler& pixelSampler, TraceState& state) const;
+	// Trace pixel with anti-aliasing, adding samples while pixel variance is high
+	Vec3f renderPixelAdaptive(size_t x, size_t y, PixelSampler& pixelSampler, TraceState& state) const;
+
+	// Progressive mode traces sparse pixels first and refines them in later passes
+	void renderProgressive(Vec3f* frameBuffer);
+	void renderPassWorker(Vec3f* frameBuffer, size_t y0, size_t y1, size_t step,
+		size_t prevStep, size_t worker, TraceState& state);
+
+	int countAC(const Ray& ray, TraceState& state) const;
+};
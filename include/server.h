@@ -0,0 +1,66 @@
+// Local render daemon, receives render jobs over a Unix domain socket
+#pragma once
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+#include "asset_cache.h"
+
+/* Job request is a list of key=value lines finished by line "end":
+ *   scene=<path>         scene file, or
+ *   inline=<bytes>       followed by that many bytes of scene file text
+ *   priority=<int>       higher priority jobs are rendered first, default 0
+ *   output=<image name>  replaces image_name of the scene
+ *   camera_pos=x,y,z  camera_rot=x,y,z  fov=<degrees>
+ * Server replies with lines:
+ *   queued <id> <jobs ahead>
+ *   load <ms> <cache hits> <cache misses>
+ *   progress <percent>
+ *   render <ms>
+ *   done <total ms> or failed <reason>
+ * Paths are resolved by the server, relative to its working directory */
+
+struct RenderJob;
+
+// Jobs are rendered one at a time, in order of priority and then arrival, each
+// one using the whole thread pool. Meshes and textures stay in cache between jobs
+class RenderServer
+{
+public:
+	RenderServer(const std::string& a_socketPath, size_t cacheSize);
+	~RenderServer();
+
+	// Accept jobs until process is stopped, returns 1 if socket could not be opened
+	int run();
+
+private:
+	void receiveJob(int fd);
+	void renderLoop();
+	void renderJob(RenderJob& job);
+
+	struct JobOrder
+	{
+		bool operator()(const std::unique_ptr<RenderJob>& a, const std::unique_ptr<RenderJob>& b) const;
+	};
+
+	const std::string socketPath;
+	AssetCache cache;
+	std::priority_queue<std::unique_ptr<RenderJob>, std::vector<std::unique_ptr<RenderJob>>, JobOrder> jobs;
+	std::mutex mutex;
+	std::condition_variable jobAdded;
+	uint64_t nextJobId = 1;
+};
+
+// Send job to server and print its replies until job is finished. First argument is
+// scene path or "-" for scene text on stdin, the rest are key=value job settings
+int runClient(const std::string& socketPath, const std::vector<std::string>& args);
+
+// Listening socket at path, a stale socket file is replaced. Both return -1 and
+// print the reason on failure
+int listenSocket(const std::string& path);
+int connectSocket(const std::string& path);
@@ -1,37 +1,104 @@
-// Used to store and output scene statistics
-#pragma once
-
-#include <iostream>
-#include <iomanip>
-#include <atomic>
-
-namespace stats
-{
-	// Here statistics data is stored
-	inline std::atomic<int> rayTriTests{ 0 };
-	inline std::atomic<int> accelStructTests{ 0 };
-	inline std::atomic<size_t> triCopiesCount{ 0 };
-	inline std::atomic<size_t> meshCount{ 0 };
-	inline std::atomic<int> acCount{ 0 };
-	inline std::atomic<int> raysCasted{ 0 };
-
-	inline void printStats()
-	{
-		std::cout.precision(2);
-		std::cout << "Statistics:\n";
-		std::cout << "Ray triangle tests:                 " << std::setw(10) 
-			<< std::scientific << rayTriTests.load() << '\n';
-		std::cout << "Ray acceleration structure tests:   " << std::setw(10) 
-			<< std::scientific << accelStructTests.load() << '\n';
-		std::cout << "Total intersection test:            " << std::setw(10) 
-			<< std::scientific << (float)rayTriTests.load() + accelStructTests.load() << '\n';
-		std::cout << "Total triangle copies:              " << std::setw(10) 
-			<< triCopiesCount.load() << '\n';
-		std::cout << "Total triangle count:               " << std::setw(10) 
-			<< meshCount.load() << '\n';
-		std::cout << "Acceleration structure count:       " << std::setw(10) 
-			<< acCount.load() << '\n';
-		std::cout << "Rays casted:                        " << std::setw(10) 
-			<< raysCasted.load() << '\n';
-	}
-}
+// Used to store and output scene statistics
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <vector>
+#include <string>
+
+#include "perf_counters.h"
+#include "memory_tracker.h"
+
+// Rays deeper than this are counted with the last depth
+const int statDepths = 16;
+
+// Counters of a single worker, plain integers merged into Stats when worker finishes.
+// Per-type arrays are indexed by RayType
+struct Counters
+{
+	size_t rayTriTests = 0;
+	size_t accelStructTests = 0;
+	size_t raysCasted = 0;
+	size_t raysByType[4] = { 0 };
+	size_t raysByDepth[statDepths] = { 0 };	// by recursion depth, shadow rays at depth of their hit point
+	size_t rayTriTestsByType[4] = { 0 };
+	size_t accelStructTestsByType[4] = { 0 };
+	size_t leavesVisited = 0;	// tree leaves whose triangles were tested
+	size_t leafTriangles = 0;	// triangles in visited leaves
+	size_t pixelSamples = 0;
+};
+
+// Shape of acceleration structures of a scene, trees shared by meshes are counted once
+struct TreeShape
+{
+	size_t trees = 0;
+	size_t nodes = 0;
+	size_t leaves = 0;
+	size_t triangleReferences = 0;	// triangles in all leaves, with copies
+	std::vector<size_t> leavesByDepth;
+	std::vector<size_t> leavesBySize;	// bucket 0 holds empty leaves, bucket k leaves of [2^(k-1), 2^k) triangles
+};
+
+// Statistics of one scene, collected while loading and over all its renders
+class Stats
+{
+public:
+	// Here statistics data is stored
+	std::atomic<size_t> rayTriTests{ 0 };
+	std::atomic<size_t> accelStructTests{ 0 };
+	std::atomic<size_t> triCopiesCount{ 0 };
+	std::atomic<size_t> meshCount{ 0 };
+	std::atomic<size_t> acCount{ 0 };
+	std::atomic<size_t> acRefits{ 0 };
+	std::atomic<size_t> acRebuilds{ 0 };	// refitted trees built again after losing quality
+	std::atomic<size_t> acBuildTime{ 0 };	// microseconds spent building trees, summed over meshes
+	std::atomic<size_t> raysCasted{ 0 };
+	std::atomic<size_t> raysByType[4] = {};
+	std::atomic<size_t> raysByDepth[statDepths] = {};
+	std::atomic<size_t> rayTriTestsByType[4] = {};
+	std::atomic<size_t> accelStructTestsByType[4] = {};
+	std::atomic<size_t> leavesVisited{ 0 };
+	std::atomic<size_t> leafTriangles{ 0 };
+	std::atomic<size_t> pixelSamples{ 0 };
+	// Performance counters summed by phase, with mask of events that were counted
+	std::atomic<uint64_t> perf[perfPhaseCount][perfEventCount] = {};
+	std::atomic<size_t> perfScopes[perfPhaseCount] = {};
+	std::atomic<unsigned> perfEvents{ 0 };
+	// Memory of scene data and render buffers
+	MemoryTracker memory;
+
+	void add(const Counters& counters)
+	{
+		rayTriTests += counters.rayTriTests;
+		accelStructTests += counters.accelStructTests;
+		raysCasted += counters.raysCasted;
+		for (int i = 0; i < 4; i++) {
+			raysByType[i] += counters.raysByType[i];
+			rayTriTestsByType[i] += counters.rayTriTestsByType[i];
+			accelStructTestsByType[i] += counters.accelStructTestsByType[i];
+		}
+		for (int i = 0; i < statDepths; i++)
+			raysByDepth[i] += counters.raysByDepth[i];
+		leavesVisited += counters.leavesVisited;
+		leafTriangles += counters.leafTriangles;
+		pixelSamples += counters.pixelSamples;
+	}
+
+	void addPerf(PerfPhase phase, const PerfValues& start, const PerfValues& end, unsigned events)
+	{
+		for (int i = 0; i < perfEventCount; i++)
+			if (events & (1u << i))
+				perf[(int)phase][i] += end.values[i] - start.values[i];
+		perfScopes[(int)phase]++;
+		perfEvents |= events;
+	}
+
+	// Print statistics, tree shape is printed if it has any trees. Performance
+	// counters are printed if any phase was counted
+	void print(const TreeShape& shape = TreeShape()) const;
+	// Write statistics and tree shape as JSON, returns false if file could not be written
+	bool writeJSON(const std::string& path, const TreeShape& shape) const;
+	// Print performance counters of every phase and rates derived from them
+	void printPerf() const;
+};
@@ -0,0 +1,52 @@
+// Fixed size thread pool, used to run independent tasks such as asset loading and rendering
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+class ThreadPool
+{
+public:
+	// Zero threads means one thread per hardware core
+	ThreadPool(size_t nThreads = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Schedule task for execution, returned future becomes ready once task is finished
+	template<typename F>
+	auto submit(F&& task) -> std::future<decltype(task())>
+	{
+		using Result = decltype(task());
+		auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+		std::future<Result> result = packaged->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.emplace([packaged]() { (*packaged)(); });
+		}
+		condition.notify_one();
+		return result;
+	}
+
+	size_t size() const { return workers.size(); }
+
+	// Process-wide pool with one thread per core, shared by all scenes by default.
+	// Tasks must not wait for other tasks of the same pool
+	static ThreadPool& shared();
+
+private:
+	void workerLoop();
+
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool stopping = false;
+};
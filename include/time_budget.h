@@ -0,0 +1,60 @@
+// Time budget of a render, lowers quality tile by tile to finish in time
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <string>
+
+#include "options.h"
+
+class RenderContext;
+
+/* Quality levels go from full quality of options down to primary rays only,
+ * every level lowers one knob: anti-aliasing samples, area light samples and ray
+ * depth. Before render a pilot traces a sparse grid of pixels at full quality,
+ * and at lower levels until estimated time of the whole image fits the budget.
+ * Pilot also weighs every tile by cost of its pixels, so that progress is
+ * measured in work rather than in tiles. During render finished tiles measure
+ * cost of their level, and level is lowered when the rest of image would not be
+ * finished in time, or raised again when a better level fits */
+class TimeBudget
+{
+public:
+	// Budget for tiles [firstTile, endTile) starts counting when it is created,
+	// tiles restored from checkpoint are left out
+	TimeBudget(RenderContext& a_ctx, size_t firstTile, size_t endTile);
+
+	// Weigh tiles and choose starting level
+	void pilot();
+	// Level to render next tile with, and its quality settings
+	size_t level() const;
+	const Quality& quality(size_t level) const { return levels[level]; }
+	// Account finished tile and time its worker spent on it, may be called from any worker
+	void tileFinished(size_t tile, size_t tileLevel, std::chrono::steady_clock::duration tileTime);
+	// Print estimate and tiles rendered at every lowered level
+	void report() const;
+
+private:
+	// Wall time per unit of tile weight, negative if it cannot be estimated yet
+	double estimate(size_t level) const;
+	std::string describe(const Quality& quality) const;
+
+	RenderContext& ctx;
+	const std::chrono::steady_clock::time_point start, deadline;
+	const size_t firstTile;
+	size_t pixelCount = 0;
+	std::vector<Quality> levels;
+	std::vector<double> pilotCost;	// wall ns per pixel of pilot grid
+	std::vector<double> renderCost;	// wall ns per unit of weight while rendering
+	std::vector<size_t> levelTiles;
+	std::vector<double> busyTime;	// ns workers spent on finished tiles of every level
+	std::vector<double> busyWeight;	// weight of those tiles
+	std::vector<double> weights;	// relative cost of tiles at full quality
+	double totalWeight = 0;
+	double fullEstimate = -1;	// ms of whole image at full quality
+
+	mutable std::mutex mutex;
+	size_t current = 0;
+	double finishedWeight = 0;
+};
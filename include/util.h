@@ -1,100 +1,163 @@
-// utility functions
-#pragma once
-
-#define _USE_MATH_DEFINES
-#include <math.h>
-#include <iostream>
-#include <vector>
-#include <sstream>
-
-#include "geometry.h"
-#include "options.h"
-
-#define LOG_ERROR() logError(__FILE__, __FUNCTION__, __LINE__)
-
-inline void logError(const char* file, const char* func, int line)
-{
-	std::cout << "Error: " << file << ' ' << func << ' ' << line << '\n';
-	std::exit(-1);
-}
-
-inline float modulo(const float& f)
-{
-	return f - std::floor(f);
-}
-
-inline float clamp(const float low, const float high, const float val)
-{
-	return std::max(low, std::min(high, val));
-}
-
-inline float degToRad(const float& f)
-{
-	return f * (float)(M_PI) / 180.0f;
-}
-
-inline float radToDeg(const float& f)
-{
-	return f * (180.0f / (float)(M_PI));
-}
-
-inline bool strToBool(const std::string_view& str)
-{
-	bool result = 0;
-	std::stringstream ss{ std::string(str) };
-	ss >> result;
-	if (!ss.eof() && !ss.good())
-		LOG_ERROR();
-	return result;
-}
-
-inline int strToInt(const std::string_view& str)
-{
-	int result = 0;
-	std::stringstream ss{ std::string(str) };
-	ss >> result;
-	if (!ss.eof() && !ss.good())
-		LOG_ERROR();
-	return result;
-}
-
-inline float strToFloat(const std::string_view& str)
-{
-	float result = 0;
-	std::stringstream ss{ std::string(str) };
-	ss >> result;
-	if (!ss.eof() && !ss.good())
-		LOG_ERROR();
-	return result;
-}
-
-inline Vec3f str3ToFloat(std::vector<std::string> vec)
-{
-	if (vec.size() != 3)
-		LOG_ERROR();
-	return Vec3f{ strToFloat(vec[0]), strToFloat(vec[1]), strToFloat(vec[2]) };
-}
-
-inline std::vector<std::string> splitString(const std::string_view& str, const char delim)
-{
-	std::vector<std::string> res;
-	std::stringstream lineStream{ std::string(str) };
-	std::string cell;
-	while (std::getline(lineStream, cell, delim))
-		res.push_back(cell);
-	return res;
-}
-
-inline bool strContains(const std::string_view& str, const std::string_view& substr)
-{
-	return str.find(substr) != std::string::npos;
-};
-
-inline bool strEquals(const std::string_view& str1, const std::string_view& str2)
-{
-	return str1.compare(str2) == 0;
-};
-
-int saveImage(Vec3f* frameBuffer, const Options& options);
-
-unsigned char* loadBMP(const char* filename, int& width, int& height);
+// utility functions
+#pragma once
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <charconv>
+
+#include "geometry.h"
+#include "options.h"
+
+#define LOG_ERROR() logError(__FILE__, __FUNCTION__, __LINE__)
+
+inline void logError(const char* file, const char* func, int line)
+{
+	std::cout << "Error: " << file << ' ' << func << ' ' << line << '\n';
+	std::exit(-1);
+}
+
+inline float modulo(const float& f)
+{
+	return f - std::floor(f);
+}
+
+inline float clamp(const float low, const float high, const float val)
+{
+	return std::max(low, std::min(high, val));
+}
+
+inline float degToRad(const float& f)
+{
+	return f * (float)(M_PI) / 180.0f;
+}
+
+inline float radToDeg(const float& f)
+{
+	return f * (180.0f / (float)(M_PI));
+}
+
+// Rotation by Euler angles in degrees, around x axis first and z axis last
+inline Matrix44f rotationMatrix(const Vec3f& rot)
+{
+	const float& x = degToRad(rot.x);
+	Matrix44f mx(
+		1, 0, 0, 0,
+		0, cosf(x), -sinf(x), 0,
+		0, sinf(x), cosf(x), 0,
+		0, 0, 0, 1
+	);
+
+	const float& y = degToRad(rot.y);
+	Matrix44f my(
+		cosf(y), 0, sinf(y), 0,
+		0, 1, 0, 0,
+		-sinf(y), 0, cosf(y), 0,
+		0, 0, 0, 1
+	);
+
+	const float& z = degToRad(rot.z);
+	Matrix44f mz(
+		cosf(z), -sinf(z), 0, 0,
+		sinf(z), cosf(z), 0, 0,
+		0, 0, 1, 0,
+		0, 0, 0, 1
+	);
+
+	return mz * my * mx;
+}
+
+// Parse whole string as a number, surrounding spaces are allowed
+template<typename T>
+inline bool parseNumber(std::string_view str, T& result)
+{
+	while (!str.empty() && (str.front() == ' ' || str.front() == '\t'))
+		str.remove_prefix(1);
+	while (!str.empty() && (str.back() == ' ' || str.back() == '\t' || str.back() == '\r'))
+		str.remove_suffix(1);
+	if (!str.empty() && str.front() == '+')
+		str.remove_prefix(1);
+	const char* end = str.data() + str.size();
+	auto [ptr, ec] = std::from_chars(str.data(), end, result);
+	return !str.empty() && ec == std::errc() && ptr == end;
+}
+
+inline bool parseBool(const std::string_view& str, bool& result)
+{
+	int value = 0;
+	if (str == "true" || str == "false") {
+		result = str == "true";
+		return true;
+	}
+	if (!parseNumber(str, value) || (value != 0 && value != 1))
+		return false;
+	result = value;
+	return true;
+}
+
+// Parse three comma separated floats
+inline bool parseVec3(const std::string_view& str, Vec3f& result)
+{
+	size_t start = 0;
+	for (int i = 0; i < 3; i++) {
+		size_t end = i < 2 ? str.find(',', start) : str.size();
+		if (end == std::string_view::npos || !parseNumber(str.substr(start, end - start), result[i]))
+			return false;
+		start = end + 1;
+	}
+	return true;
+}
+
+// Split string into views of the original string, no copies are made
+inline std::vector<std::string_view> splitString(const std::string_view& str, const char delim)
+{
+	std::vector<std::string_view> res;
+	size_t start = 0;
+	while (start < str.size()) {
+		size_t end = str.find(delim, start);
+		if (end == std::string_view::npos)
+			end = str.size();
+		res.push_back(str.substr(start, end - start));
+		start = end + 1;
+	}
+	return res;
+}
+
+inline bool strContains(const std::string_view& str, const std::string_view& substr)
+{
+	return str.find(substr) != std::string::npos;
+};
+
+inline bool strEquals(const std::string_view& str1, const std::string_view& str2)
+{
+	return str1.compare(str2) == 0;
+};
+
+// Read-only view of a whole file, memory-mapped where it is supported
+class MappedFile
+{
+public:
+	MappedFile(const std::string& path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool good() const { return opened; }
+	std::string_view view() const { return std::string_view(data, size); }
+
+private:
+	bool opened = false;
+	const char* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	std::string buffer;
+#endif
+};
+
+unsigned char* loadBMP(const char* filename, int& width, int& height);
+// Read only dimensions from header of .bmp file, false if file could not be read
+bool readBMPSize(const char* filename, int& width, int& height);
@@ -0,0 +1,41 @@
+// Keyframed camera and object motion, rendered as a sequence of frames
+#include "animation.h"
+
+#include <algorithm>
+
+void Track::addKey(int frame, const Vec3f& value)
+{
+	auto key = std::lower_bound(keys.begin(), keys.end(), frame,
+		[](const Key& key, int frame) { return key.frame < frame; });
+	if (key != keys.end() && key->frame == frame)
+		key->value = value;
+	else
+		keys.insert(key, Key{ frame, value });
+}
+
+Vec3f Track::at(int frame) const
+{
+	if (frame <= keys.front().frame)
+		return keys.front().value;
+	if (frame >= keys.back().frame)
+		return keys.back().value;
+
+	// First key after frame, frame lies between it and the previous one
+	auto next = std::upper_bound(keys.begin(), keys.end(), frame,
+		[](int frame, const Key& key) { return frame < key.frame; });
+	auto prev = next - 1;
+	const float t = (float)(frame - prev->frame) / (next->frame - prev->frame);
+	return prev->value * (1 - t) + next->value * t;
+}
+
+
+ObjectMotion& Animation::object(size_t index)
+{
+	for (ObjectMotion& motion : objects)
+		if (motion.object == index)
+			return motion;
+	ObjectMotion motion;
+	motion.object = index;
+	objects.push_back(std::move(motion));
+	return objects.back();
+}
@@ -0,0 +1,42 @@
+// Least recently used cache of loaded meshes and textures, shared by scenes loaded one after another
+#include "asset_cache.h"
+
+AssetCache::AssetCache(size_t a_capacity)
+	: capacity(a_capacity) {}
+
+std::shared_ptr<void> AssetCache::find(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto found = index.find(key);
+	if (found == index.end()) {
+		misses++;
+		return nullptr;
+	}
+	hits++;
+	entries.splice(entries.begin(), entries, found->second);
+	return found->second->asset;
+}
+
+void AssetCache::insert(const std::string& key, std::shared_ptr<void> asset, size_t assetSize)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	// Asset loaded twice at once is kept only once
+	if (index.count(key))
+		return;
+	entries.push_front(Entry{ key, std::move(asset), assetSize });
+	index[key] = entries.begin();
+	used += assetSize;
+
+	// Asset larger than the whole cache is not kept either
+	while (used > capacity && !entries.empty()) {
+		used -= entries.back().size;
+		index.erase(entries.back().key);
+		entries.pop_back();
+	}
+}
+
+size_t AssetCache::size() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return used;
+}
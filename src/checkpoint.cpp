@@ -0,0 +1,149 @@
+// Checkpoint of tiled render, log of finished tiles that a stopped render resumes from
+#include "checkpoint.h"
+
+#include <iostream>
+#include <filesystem>
+#include <cstring>
+#include <cstdint>
+
+#include "image.h"
+
+namespace
+{
+	struct CheckpointHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t width, height, tileSize;
+		uint32_t reserved;
+		uint64_t sceneHash;
+	};
+
+	const char checkpointMagic[4] = { 'R', 'T', 'C', 'P' };
+	const uint32_t checkpointVersion = 2;
+
+	template<typename T>
+	void hashValue(uint64_t& hash, const T& value)
+	{
+		const uint8_t* bytes = (const uint8_t*)&value;
+		for (size_t i = 0; i < sizeof(T); i++) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	}
+
+	// Scene text, camera and options that change pixels. Output, statistics, threads
+	// and time budget do not, so they may differ when render is resumed
+	uint64_t hashScene(uint64_t sourceHash, const Options& options, const Camera& camera)
+	{
+		uint64_t hash = sourceHash;
+		hashValue(hash, camera.pos);
+		hashValue(hash, camera.rot);
+		hashValue(hash, camera.fov);
+		hashValue(hash, options.useBackfaceCulling);
+		hashValue(hash, options.useSkybox);
+		hashValue(hash, options.useTextures);
+		hashValue(hash, options.showNormals);
+		hashValue(hash, options.antialiasing);
+		hashValue(hash, options.bias);
+		hashValue(hash, options.maxRayDepth);
+		hashValue(hash, options.backgroundColor);
+		hashValue(hash, options.aaMinSamples);
+		hashValue(hash, options.aaMaxSamples);
+		hashValue(hash, options.aaThreshold);
+		hashValue(hash, options.aaFilter);
+		hashValue(hash, options.aaFilterWidth);
+		hashValue(hash, options.samplerType);
+		hashValue(hash, options.names);
+		return hash;
+	}
+}
+
+TileCheckpoint::TileCheckpoint(const Options& options, uint64_t sourceHash, const Camera& camera)
+	: path(imagePath(options) + ".checkpoint"), width(options.width), height(options.height),
+	tileSize(std::max(1, options.tileSize)), tilesX((width + tileSize - 1) / tileSize),
+	sceneHash(hashScene(sourceHash, options, camera)), interval(std::max(0, options.checkpointInterval)) {}
+
+size_t TileCheckpoint::open(bool resume, std::vector<char>& doneTiles, const TileCallback& onRestored)
+{
+	const size_t tileCount = tilesX * ((height + tileSize - 1) / tileSize);
+	doneTiles.assign(tileCount, 0);
+	size_t restored = 0;
+	std::streamoff validSize = 0;
+
+	std::ifstream previous(resume ? path : std::string(), std::ios::binary);
+	CheckpointHeader header;
+	if (previous.read((char*)&header, sizeof(header))) {
+		if (memcmp(header.magic, checkpointMagic, 4) != 0 || header.version != checkpointVersion ||
+			header.width != width || header.height != height || header.tileSize != tileSize) {
+			std::cout << "Checkpoint " << path << " belongs to a different image, render starts over\n";
+		}
+		else if (header.sceneHash != sceneHash) {
+			std::cout << "Checkpoint " << path << " was rendered from a different scene or options, render starts over\n";
+		}
+		else {
+			// Tiles are read until end of file or the first incomplete one
+			validSize = sizeof(header);
+			std::vector<Vec3f> pixels(tileSize * tileSize);
+			uint32_t tile;
+			while (previous.read((char*)&tile, sizeof(tile)) && tile < tileCount) {
+				const size_t x0 = tile % tilesX * tileSize, x1 = std::min(x0 + tileSize, width);
+				const size_t y0 = tile / tilesX * tileSize, y1 = std::min(y0 + tileSize, height);
+				if (!previous.read((char*)pixels.data(), (x1 - x0) * (y1 - y0) * sizeof(Vec3f)))
+					break;
+				validSize = previous.tellg();
+				if (!doneTiles[tile]) {
+					doneTiles[tile] = 1;
+					restored++;
+					onRestored(pixels.data(), x1 - x0, x0, y0, x1, y1);
+				}
+			}
+		}
+	}
+	previous.close();
+
+	// Continued file drops the incomplete tile, new file gets a header
+	if (validSize > 0) {
+		std::filesystem::resize_file(path, validSize);
+		file.open(path, std::ios::binary | std::ios::app);
+	}
+	else {
+		file.open(path, std::ios::binary | std::ios::trunc);
+		CheckpointHeader newHeader{ { 0 }, checkpointVersion, (uint32_t)width, (uint32_t)height, (uint32_t)tileSize, 0, sceneHash };
+		memcpy(newHeader.magic, checkpointMagic, 4);
+		file.write((const char*)&newHeader, sizeof(newHeader));
+		file.flush();
+	}
+	lastFlush = std::chrono::steady_clock::now();
+	return restored;
+}
+
+void TileCheckpoint::add(const Vec3f* pixels, size_t stride, size_t x0, size_t y0, size_t x1, size_t y1)
+{
+	const uint32_t tile = (uint32_t)(y0 / tileSize * tilesX + x0 / tileSize);
+	std::lock_guard<std::mutex> lock(mutex);
+	file.write((const char*)&tile, sizeof(tile));
+	for (size_t y = y0; y < y1; y++)
+		file.write((const char*)(pixels + (y - y0) * stride), (x1 - x0) * sizeof(Vec3f));
+
+	auto now = std::chrono::steady_clock::now();
+	if (now - lastFlush >= interval) {
+		file.flush();
+		lastFlush = now;
+	}
+}
+
+bool TileCheckpoint::flush()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	file.flush();
+	return file.good();
+}
+
+void TileCheckpoint::remove()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	file.close();
+	std::error_code error;
+	std::filesystem::remove(path, error);
+}
@@ -0,0 +1,116 @@
+// Flat render-ready snapshot of a scene, compiled when render starts
+#include "compiled_scene.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include "scene.h"
+#include "lights.h"
+#include "profiler.h"
+
+namespace
+{
+	// Light intensity falls off as intensity / (4 * pi * d^2 / 1000), constant
+	// part of that is folded into power
+	float lightPower(const float intensity)
+	{
+		return (float)(intensity * 1000 / (4 * M_PI));
+	}
+}
+
+Ray CameraBasis::getRay(float x, float y, size_t width, size_t height) const
+{
+	const float xPix = (2 * x / (float)width - 1) * scale * aspectRatio;
+	const float yPix = -(2 * y / (float)height - 1) * scale;
+	const Vec3f dir = Vec3f(xPix, yPix, -1).normalize();
+	return Ray{ pos, right * dir.x + up * dir.y + back * dir.z };
+}
+
+
+CompiledScene::CompiledScene(const Scene& scene, const Options& options, const Camera& a_camera)
+{
+	PROFILE_ZONE("Compile scene");
+	// Lights are split by type, lights of unknown type are not rendered
+	for (const auto& light : scene.lights) {
+		if (light->type == LightType::DistantLight) {
+			const DistantLight& distant = static_cast<const DistantLight&>(*light);
+			distantLights.push_back(DistantLightRecord{ distant.dir, distant.color * distant.intensity });
+		}
+		else if (light->type == LightType::PointLight) {
+			const PointLight& point = static_cast<const PointLight&>(*light);
+			pointLights.push_back(PointLightRecord{ point.pos, point.color, lightPower(point.intensity) });
+		}
+		else if (light->type == LightType::AreaLight) {
+			const AreaLight& area = static_cast<const AreaLight&>(*light);
+			AreaLightRecord record;
+			record.pos = area.pos;
+			record.i = area.i;
+			record.j = area.j;
+			record.color = area.color;
+			record.power = lightPower(area.intensity);
+			record.sampleCount = (uint32_t)area.sampleCount();
+			record.firstPoint = (uint32_t)areaPoints.size();
+
+			// Single sample goes to center, regular sampler uses fixed grid of points
+			// and other samplers spread points of their sets over the parallelogram
+			record.fixedPoints = area.samples <= 1 || options.samplerType == SamplerType::Regular;
+			if (area.samples <= 1) {
+				areaPoints.push_back(area.pos);
+			}
+			else if (record.fixedPoints) {
+				const Vec3f corner = area.pos - (area.i / 2.0f) - (area.j / 2.0f);
+				for (int ii = 0; ii < area.samples; ii++)
+					for (int jj = 0; jj < area.samples; jj++)
+						areaPoints.push_back(corner + (area.i * (((float)ii) / (area.samples - 1))) + (area.j * (((float)jj) / (area.samples - 1))));
+			}
+			areaLights.push_back(record);
+		}
+	}
+
+	// Every object gets its own entry in material table
+	for (const auto& object : scene.objects) {
+		const Mesh* mesh = object->objectType == ObjectType::Mesh ? static_cast<const Mesh*>(object.get()) : nullptr;
+		MaterialRecord material;
+		material.type = object->materialType;
+		material.color = object->color;
+		material.ambient = object->ambient;
+		material.diffuse = object->diffuse;
+		material.specular = object->specular;
+		material.nSpecular = object->nSpecular;
+		material.indexOfRefraction = object->indexOfRefraction;
+		material.textures = mesh && (mesh->diffuseMap || mesh->specularMap) ? mesh : nullptr;
+
+		ObjectRecord record;
+		record.type = object->objectType;
+		record.material = (uint32_t)materials.size();
+		record.castsShadow = object->materialType != MaterialType::Transparent;
+		record.pos = object->pos;
+		record.normal = 0;
+		record.r2 = 0;
+		record.object = object.get();
+		record.ac = mesh ? mesh->geometry->ac.get() : nullptr;
+		if (object->objectType == ObjectType::Sphere)
+			record.r2 = static_cast<const Sphere&>(*object).r2;
+		else if (object->objectType == ObjectType::Plane)
+			record.normal = static_cast<const Plane&>(*object).normal;
+
+		materials.push_back(material);
+		objects.push_back(record);
+	}
+
+	// Rows of rotation matrix are camera axes
+	const Matrix44f& m = a_camera.rMatrix;
+	camera.pos = a_camera.pos;
+	camera.right = Vec3f{ m[0][0], m[0][1], m[0][2] };
+	camera.up = Vec3f{ m[1][0], m[1][1], m[1][2] };
+	camera.back = Vec3f{ m[2][0], m[2][1], m[2][2] };
+	camera.scale = tanf(a_camera.fov * 0.5f / 180.0f * (float)(M_PI));
+	camera.aspectRatio = options.width / (float)options.height;
+
+	if (options.useSkybox) {
+		skyboxWidth = scene.skyboxWidth;
+		skyboxHeight = scene.skyboxHeight;
+		for (int k = 0; k < 6; k++)
+			skyboxes[k] = scene.skyboxes[k];
+	}
+}
@@ -0,0 +1,532 @@
+// Distributed rendering of one frame by several worker processes
+#include "coordinator.h"
+
+// Unix domain sockets and process spawning are used only on POSIX systems
+#ifndef _WIN32
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <spawn.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <cstring>
+#include <cstdint>
+
+#include "scene.h"
+#include "server.h"
+#include "image.h"
+#include "thread_pool.h"
+#include "timer.h"
+
+extern char** environ;
+
+namespace
+{
+	enum class MessageType : uint32_t
+	{
+		Hello = 1,
+		Assign,
+		Tile,
+		RangeDone,
+		Finish,
+	};
+
+	struct MessageHeader
+	{
+		uint32_t type;
+		uint32_t size;	// bytes of payload after header
+	};
+
+	// Output path follows hello in the same message
+	struct HelloMessage
+	{
+		uint32_t width, height, tileSize, threads, format;
+	};
+
+	struct AssignMessage
+	{
+		uint64_t first, last;
+	};
+
+	// Pixels follow tile corners, row by row without padding
+	struct TileMessage
+	{
+		uint32_t x0, y0, x1, y1;
+	};
+
+	static_assert(sizeof(Vec3f) == 3 * sizeof(float), "tile pixels are sent as they are in memory");
+
+	bool sendAll(int fd, const void* data, size_t size)
+	{
+		for (size_t sent = 0; sent < size;) {
+			ssize_t n = send(fd, (const char*)data + sent, size - sent, MSG_NOSIGNAL);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			sent += n;
+		}
+		return true;
+	}
+
+	bool receiveAll(int fd, void* data, size_t size)
+	{
+		for (size_t received = 0; received < size;) {
+			ssize_t n = recv(fd, (char*)data + received, size - received, 0);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			received += n;
+		}
+		return true;
+	}
+
+	// Header and payload are sent with one call, so that messages written from
+	// several threads are never interleaved as long as callers hold a lock
+	bool sendMessage(int fd, MessageType type, const void* payload, size_t size)
+	{
+		MessageHeader header{ (uint32_t)type, (uint32_t)size };
+		std::vector<char> data((const char*)&header, (const char*)&header + sizeof(header));
+		data.insert(data.end(), (const char*)payload, (const char*)payload + size);
+		return sendAll(fd, data.data(), data.size());
+	}
+
+	struct TileRange
+	{
+		size_t first, last;
+	};
+
+	struct WorkerLink
+	{
+		int fd = -1;
+		std::string buffer;	// received bytes not yet parsed into messages
+		bool greeted = false;
+		size_t threads = 1;
+		size_t tiles = 0;	// tiles received from this worker
+		std::deque<TileRange> assigned;	// ranges sent to worker, oldest first
+		// Last tile or finished range received, or when worker got work while it had none
+		std::chrono::steady_clock::time_point lastProgress;
+	};
+
+	// Process on the other end of worker socket, 0 if it is not known
+	pid_t peerProcess(int fd)
+	{
+#ifdef SO_PEERCRED
+		ucred credentials;
+		socklen_t length = sizeof(credentials);
+		if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0)
+			return credentials.pid;
+#endif
+		return 0;
+	}
+
+	class Coordinator
+	{
+	public:
+		Coordinator(int a_listener, std::chrono::seconds a_timeout) : listener(a_listener), timeout(a_timeout) {}
+
+		// Poll sockets until image is finished or no worker is left to finish it
+		bool run(std::vector<pid_t>& children);
+		// Tell workers to exit and close output file, false if image was not written
+		bool finish(bool complete);
+
+	private:
+		void accept();
+		// Parse and handle all complete messages, false if worker has to be dropped
+		bool receive(WorkerLink& worker);
+		bool handle(WorkerLink& worker, MessageType type, const char* payload, size_t size);
+		bool hello(WorkerLink& worker, const char* payload, size_t size);
+		bool tile(WorkerLink& worker, const char* payload, size_t size);
+		// Give tiles to workers with less than two outstanding ranges
+		void dispatch();
+		// Return unreceived tiles of worker ranges to pending ranges
+		void drop(size_t index, const char* reason);
+
+		const int listener;
+		const std::chrono::seconds timeout;	// worker with tiles assigned that sends none for this long is dropped
+		std::vector<WorkerLink> workers;
+		size_t workersSeen = 0;
+		bool failed = false;
+
+		// Image is defined by the first worker, the rest have to match it
+		std::unique_ptr<ImageWriter> writer;
+		size_t tileSize = 0, tilesX = 0, tileCount = 0;
+		std::vector<char> received;
+		size_t receivedCount = 0;
+		std::deque<TileRange> pending;
+	};
+
+	bool Coordinator::run(std::vector<pid_t>& children)
+	{
+		const bool startedChildren = !children.empty();
+		auto lastReport = std::chrono::steady_clock::now();
+		while (!writer || receivedCount < tileCount) {
+			std::vector<pollfd> fds{ pollfd{ listener, POLLIN, 0 } };
+			for (const WorkerLink& worker : workers)
+				fds.push_back(pollfd{ worker.fd, POLLIN, 0 });
+			if (poll(fds.data(), fds.size(), 1000) < 0 && errno != EINTR) {
+				std::cout << "Could not poll worker sockets: " << strerror(errno) << '\n';
+				return false;
+			}
+
+			// Workers are dropped from the back, so indices of fds stay valid
+			for (size_t i = fds.size() - 1; i > 0; i--) {
+				if (fds[i].revents && !receive(workers[i - 1]))
+					drop(i - 1, "disconnected");
+			}
+			if (fds[0].revents & POLLIN)
+				accept();
+
+			// Stalled local worker is killed, so that it is not waited for at exit
+			auto now = std::chrono::steady_clock::now();
+			for (size_t i = workers.size(); i-- > 0;) {
+				if (workers[i].assigned.empty() || now - workers[i].lastProgress < timeout)
+					continue;
+				const pid_t peer = peerProcess(workers[i].fd);
+				if (peer > 0 && std::find(children.begin(), children.end(), peer) != children.end())
+					kill(peer, SIGKILL);
+				drop(i, "stalled");
+			}
+			dispatch();
+
+			// Exited local workers are reaped, their tiles are already returned by drop
+			for (size_t i = 0; i < children.size();) {
+				int status;
+				if (waitpid(children[i], &status, WNOHANG) == children[i]) {
+					if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+						std::cout << "Worker process " << children[i] << " failed\n";
+					children.erase(children.begin() + i);
+				}
+				else {
+					i++;
+				}
+			}
+			if (failed)
+				return false;
+			// Without local workers coordinator waits for the first worker to connect
+			if (workers.empty() && children.empty() && (workersSeen > 0 || startedChildren)) {
+				if (writer)
+					std::cout << "All workers are gone, " << tileCount - receivedCount << " tiles were not rendered\n";
+				else
+					std::cout << "All workers exited before rendering\n";
+				return false;
+			}
+
+			if (writer && std::chrono::duration_cast<std::chrono::milliseconds>(now - lastReport).count() >= 1000ll) {
+				std::cout << std::fixed << std::setw(2) << std::setprecision(0) << 100.0f * receivedCount / tileCount << "%\n";
+				lastReport = now;
+			}
+		}
+		return true;
+	}
+
+	bool Coordinator::finish(bool complete)
+	{
+		for (size_t i = 0; i < workers.size(); i++) {
+			if (complete) {
+				sendMessage(workers[i].fd, MessageType::Finish, nullptr, 0);
+				std::cout << "Worker " << i + 1 << " rendered " << workers[i].tiles << " tiles\n";
+				// Closing socket with unread data resets it, so worker could lose finish
+				// message. Anything it still sends is read until it closes, at most a second
+				shutdown(workers[i].fd, SHUT_WR);
+				char chunk[4096];
+				pollfd fd{ workers[i].fd, POLLIN, 0 };
+				while (poll(&fd, 1, 1000) > 0 && recv(workers[i].fd, chunk, sizeof(chunk), 0) > 0) {}
+			}
+			close(workers[i].fd);
+		}
+		workers.clear();
+		if (!writer)
+			return false;
+		if (!writer->close()) {
+			std::cout << "Could not write output file " << writer->path << '\n';
+			return false;
+		}
+		if (complete)
+			std::cout << "Successfully wrote to output file " << writer->path << '\n';
+		return complete;
+	}
+
+	void Coordinator::accept()
+	{
+		int fd = ::accept(listener, nullptr, nullptr);
+		if (fd < 0)
+			return;
+		WorkerLink worker;
+		worker.fd = fd;
+		workers.push_back(std::move(worker));
+	}
+
+	bool Coordinator::receive(WorkerLink& worker)
+	{
+		char chunk[1 << 16];
+		ssize_t n = recv(worker.fd, chunk, sizeof(chunk), 0);
+		if (n < 0 && errno == EINTR)
+			return true;
+		if (n <= 0)
+			return false;
+		worker.buffer.append(chunk, n);
+
+		size_t offset = 0;
+		MessageHeader header;
+		while (worker.buffer.size() - offset >= sizeof(header)) {
+			memcpy(&header, worker.buffer.data() + offset, sizeof(header));
+			if (worker.buffer.size() - offset - sizeof(header) < header.size)
+				break;
+			if (!handle(worker, (MessageType)header.type, worker.buffer.data() + offset + sizeof(header), header.size))
+				return false;
+			offset += sizeof(header) + header.size;
+		}
+		worker.buffer.erase(0, offset);
+		return true;
+	}
+
+	bool Coordinator::handle(WorkerLink& worker, MessageType type, const char* payload, size_t size)
+	{
+		if (type == MessageType::Hello)
+			return !worker.greeted && hello(worker, payload, size);
+		if (!worker.greeted)
+			return false;
+		if (type == MessageType::Tile)
+			return tile(worker, payload, size);
+		if (type == MessageType::RangeDone && !worker.assigned.empty()) {
+			worker.assigned.pop_front();
+			worker.lastProgress = std::chrono::steady_clock::now();
+			return true;
+		}
+		std::cout << "Unexpected message from worker\n";
+		return false;
+	}
+
+	bool Coordinator::hello(WorkerLink& worker, const char* payload, size_t size)
+	{
+		HelloMessage message;
+		if (size < sizeof(message))
+			return false;
+		memcpy(&message, payload, sizeof(message));
+		const std::string path(payload + sizeof(message), size - sizeof(message));
+		if (message.width == 0 || message.height == 0 || message.tileSize == 0 ||
+			message.format > (uint32_t)ImageFormat::PFM) {
+			std::cout << "Worker sent invalid image settings\n";
+			return false;
+		}
+
+		if (!writer) {
+			writer = std::make_unique<ImageWriter>(path, message.width, message.height, (ImageFormat)message.format);
+			if (!writer->good()) {
+				std::cout << "Could not open output file " << path << '\n';
+				failed = true;
+				return false;
+			}
+			tileSize = message.tileSize;
+			tilesX = (message.width + tileSize - 1) / tileSize;
+			tileCount = tilesX * ((message.height + tileSize - 1) / tileSize);
+			received.assign(tileCount, 0);
+			pending.push_back(TileRange{ 0, tileCount });
+		}
+		else if (message.width != writer->width || message.height != writer->height || message.tileSize != tileSize ||
+			(ImageFormat)message.format != writer->format || path != writer->path) {
+			std::cout << "Worker renders a different image, it is not used\n";
+			return false;
+		}
+
+		worker.greeted = true;
+		worker.threads = std::max<uint32_t>(1, message.threads);
+		workersSeen++;
+		return true;
+	}
+
+	bool Coordinator::tile(WorkerLink& worker, const char* payload, size_t size)
+	{
+		TileMessage message;
+		if (size < sizeof(message))
+			return false;
+		memcpy(&message, payload, sizeof(message));
+		const size_t tile = message.y0 / tileSize * tilesX + message.x0 / tileSize;
+		const size_t width = message.x1 - message.x0;
+		if (message.x0 % tileSize || message.y0 % tileSize || message.x1 <= message.x0 || message.y1 <= message.y0 ||
+			message.x1 > writer->width || message.y1 > writer->height || tile >= tileCount ||
+			size != sizeof(message) + width * (message.y1 - message.y0) * sizeof(Vec3f)) {
+			std::cout << "Worker sent invalid tile\n";
+			return false;
+		}
+		worker.lastProgress = std::chrono::steady_clock::now();
+
+		// Tile of a dropped worker may still come from somewhere else only once
+		if (!received[tile]) {
+			std::vector<Vec3f> pixels(width * (message.y1 - message.y0));
+			memcpy(pixels.data(), payload + sizeof(message), pixels.size() * sizeof(Vec3f));
+			writer->writeTile(pixels.data(), width, message.x0, message.y0, message.x1, message.y1);
+			received[tile] = 1;
+			receivedCount++;
+			worker.tiles++;
+		}
+		return true;
+	}
+
+	void Coordinator::dispatch()
+	{
+		for (WorkerLink& worker : workers) {
+			// Second range is queued by worker, so it never waits for the next one
+			while (worker.greeted && worker.assigned.size() < 2 && !pending.empty()) {
+				TileRange& next = pending.front();
+				TileRange range{ next.first, std::min(next.last, next.first + 4 * worker.threads) };
+				next.first = range.last;
+				if (next.first == next.last)
+					pending.pop_front();
+				AssignMessage message{ range.first, range.last };
+				if (worker.assigned.empty())
+					worker.lastProgress = std::chrono::steady_clock::now();
+				worker.assigned.push_back(range);
+				if (!sendMessage(worker.fd, MessageType::Assign, &message, sizeof(message)))
+					break;	// worker is dropped once its socket reports the error
+			}
+		}
+	}
+
+	void Coordinator::drop(size_t index, const char* reason)
+	{
+		WorkerLink& worker = workers[index];
+		size_t lost = 0;
+		for (const TileRange& range : worker.assigned) {
+			// Unreceived tiles go back as runs of consecutive tiles, in front of the
+			// rest, so that image is finished in about the same order
+			for (size_t tile = range.first; tile < range.last;) {
+				if (received[tile]) {
+					tile++;
+					continue;
+				}
+				size_t end = tile;
+				while (end < range.last && !received[end])
+					end++;
+				pending.push_front(TileRange{ tile, end });
+				lost += end - tile;
+				tile = end;
+			}
+		}
+		if (worker.greeted)
+			std::cout << "Worker " << reason << ", " << lost << " of its tiles are reassigned\n";
+		close(worker.fd);
+		workers.erase(workers.begin() + index);
+	}
+}
+
+int runCoordinator(const std::string& program, const std::string& scenePath,
+	const std::string& socketPath, size_t localWorkers, size_t timeout)
+{
+	int listener = listenSocket(socketPath);
+	if (listener < 0)
+		return 1;
+	std::cout << "Listening on " << socketPath << '\n';
+	Timer t("Total time");
+
+	// Local workers split the cores between them
+	char exe[4096];
+	ssize_t exeLength = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+	const std::string exePath = exeLength > 0 ? std::string(exe, exeLength) : program;
+	const std::string threads = std::to_string(std::max<size_t>(1, std::thread::hardware_concurrency() / std::max<size_t>(1, localWorkers)));
+	std::vector<pid_t> children;
+	for (size_t i = 0; i < localWorkers; i++) {
+		std::vector<std::string> args{ exePath, "--tile-worker", scenePath, socketPath, threads };
+		std::vector<char*> argv;
+		for (std::string& arg : args)
+			argv.push_back(&arg[0]);
+		argv.push_back(nullptr);
+		pid_t pid;
+		if (posix_spawn(&pid, exePath.c_str(), nullptr, nullptr, argv.data(), environ) == 0)
+			children.push_back(pid);
+		else
+			std::cout << "Could not start worker process " << exePath << '\n';
+	}
+	if (localWorkers == 0)
+		std::cout << "Waiting for workers\n";
+
+	Coordinator coordinator(listener, std::chrono::seconds(std::max<size_t>(1, timeout)));
+	bool success = coordinator.finish(coordinator.run(children));
+	close(listener);
+	unlink(socketPath.c_str());
+	// Workers exit on finish message or once their connection is closed
+	for (pid_t child : children)
+		waitpid(child, nullptr, 0);
+	return success ? 0 : 1;
+}
+
+int runTileWorker(const std::string& scenePath, const std::string& socketPath, size_t threads)
+{
+	// Scene is loaded before connecting, so that coordinator never waits for it
+	std::unique_ptr<ThreadPool> pool;
+	Scene scene;
+	if (threads) {
+		pool = std::make_unique<ThreadPool>(threads);
+		scene.pool = pool.get();
+	}
+	scene.sceneLoadSuccess = scene.loadScene(scenePath);
+	if (!scene.sceneLoadSuccess)
+		return 1;
+	scene.options.outputProgress = false;
+	if (threads)
+		scene.options.nWorkers = (int)threads;
+
+	int fd = connectSocket(socketPath);
+	if (fd < 0)
+		return 1;
+	RenderContext ctx(scene);
+	const Options& settings = ctx.options;
+
+	// Coordinator may run in another directory, so output path is made absolute
+	const std::string path = std::filesystem::absolute(imagePath(settings)).string();
+	HelloMessage hello{ (uint32_t)settings.width, (uint32_t)settings.height, (uint32_t)std::max(1, settings.tileSize),
+		(uint32_t)settings.nWorkers, (uint32_t)settings.imageFormat };
+	std::vector<char> helloData(sizeof(hello) + path.size());
+	memcpy(helloData.data(), &hello, sizeof(hello));
+	memcpy(helloData.data() + sizeof(hello), path.data(), path.size());
+
+	std::mutex sendMutex;
+	bool connected = sendMessage(fd, MessageType::Hello, helloData.data(), helloData.size());
+	size_t tiles = 0;
+	MessageHeader header;
+	while (connected && receiveAll(fd, &header, sizeof(header))) {
+		std::vector<char> payload(header.size);
+		if (!receiveAll(fd, payload.data(), payload.size()))
+			break;
+		if ((MessageType)header.type == MessageType::Finish) {
+			close(fd);
+			std::cout << "Rendered " << tiles << " tiles\n";
+			return 0;
+		}
+		if ((MessageType)header.type != MessageType::Assign || payload.size() != sizeof(AssignMessage))
+			break;
+
+		AssignMessage assign;
+		memcpy(&assign, payload.data(), sizeof(assign));
+		ctx.renderTiles(nullptr, [&](const Vec3f* pixels, size_t stride, size_t x0, size_t y0, size_t x1, size_t y1) {
+			TileMessage message{ (uint32_t)x0, (uint32_t)y0, (uint32_t)x1, (uint32_t)y1 };
+			const size_t rowSize = (x1 - x0) * sizeof(Vec3f);
+			std::vector<char> data(sizeof(message) + rowSize * (y1 - y0));
+			memcpy(data.data(), &message, sizeof(message));
+			for (size_t y = y0; y < y1; y++)
+				memcpy(data.data() + sizeof(message) + (y - y0) * rowSize, pixels + (y - y0) * stride, rowSize);
+			std::lock_guard<std::mutex> lock(sendMutex);
+			connected = connected && sendMessage(fd, MessageType::Tile, data.data(), data.size());
+			tiles++;
+		}, assign.first, assign.last);
+		connected = connected && sendMessage(fd, MessageType::RangeDone, nullptr, 0);
+	}
+	close(fd);
+	std::cout << "Lost connection to coordinator\n";
+	return 1;
+}
+#endif // _WIN32
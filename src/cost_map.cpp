@@ -0,0 +1,116 @@
+// Per-pixel render cost, written as false color heatmaps and raw float images
+#include "cost_map.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <functional>
+
+#include "stats.h"
+#include "image.h"
+
+namespace
+{
+	// Black through purple, red and yellow to white, value is clamped to [0, 1]
+	Vec3f heatColor(float value)
+	{
+		static const Vec3f stops[] = {
+			{ 0.0f, 0.0f, 0.0f }, { 0.35f, 0.05f, 0.55f }, { 0.85f, 0.15f, 0.2f }, { 1.0f, 0.75f, 0.0f }, { 1.0f, 1.0f, 1.0f }
+		};
+		const float position = std::min(std::max(value, 0.0f), 1.0f) * 4;
+		const int i = std::min((int)position, 3);
+		const float t = position - i;
+		return stops[i] * (1 - t) + stops[i + 1] * t;
+	}
+
+	bool writeImage(const std::string& path, size_t width, size_t height, ImageFormat format, const std::vector<Vec3f>& pixels)
+	{
+		ImageWriter writer(path, width, height, format);
+		if (!writer.good())
+			return false;
+		writer.writeTile(pixels.data(), width, 0, 0, width, height);
+		return writer.close();
+	}
+}
+
+CostMap::CostMap(size_t a_width, size_t a_height)
+	: width(a_width), height(a_height), cycleCounts(a_width * a_height, 0), rays(a_width * a_height, 0),
+	triangleTests(a_width * a_height, 0), boxTests(a_width * a_height, 0)
+{
+}
+
+CostMap::Start CostMap::begin(const Counters& counters) const
+{
+	return Start{ cycles(), counters.raysCasted, counters.rayTriTests, counters.accelStructTests };
+}
+
+void CostMap::end(size_t x, size_t y, const Start& start, const Counters& counters)
+{
+	const size_t pixel = x + y * width;
+	cycleCounts[pixel] = (float)(cycles() - start.cycles);
+	rays[pixel] = (float)(counters.raysCasted - start.rays);
+	triangleTests[pixel] = (float)(counters.rayTriTests - start.triangleTests);
+	boxTests[pixel] = (float)(counters.accelStructTests - start.boxTests);
+}
+
+bool CostMap::write(const Options& options) const
+{
+	const ImageFormat format = options.imageFormat == ImageFormat::PFM ? ImageFormat::BMP : options.imageFormat;
+	const std::pair<const char*, const std::vector<float>*> metrics[] = {
+		{ "cycles", &cycleCounts }, { "rays", &rays }, { "triangles", &triangleTests }, { "boxes", &boxTests }
+	};
+	bool success = true;
+	std::vector<Vec3f> pixels(width * height);
+	for (const auto& [name, values] : metrics) {
+		// Few very costly pixels would leave the rest of heatmap dark
+		std::vector<float> sorted = *values;
+		const size_t rank = sorted.size() * 99 / 100;
+		std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+		float scale = sorted[rank];
+		if (scale <= 0)
+			scale = std::max(1.0f, *std::max_element(values->begin(), values->end()));
+
+		const std::string base = options.imageName + "_cost_" + name;
+		for (size_t i = 0; i < pixels.size(); i++)
+			pixels[i] = heatColor((*values)[i] / scale);
+		const std::string heatmapPath = base + '.' + ImageWriter::extension(format);
+		if (!writeImage(heatmapPath, width, height, format, pixels)) {
+			std::cout << "Could not write cost map " << heatmapPath << '\n';
+			success = false;
+		}
+		for (size_t i = 0; i < pixels.size(); i++)
+			pixels[i] = Vec3f{ (*values)[i] };
+		const std::string rawPath = base + '.' + ImageWriter::extension(ImageFormat::PFM);
+		if (!writeImage(rawPath, width, height, ImageFormat::PFM, pixels)) {
+			std::cout << "Could not write cost map " << rawPath << '\n';
+			success = false;
+		}
+	}
+	if (success && options.enableOutput)
+		std::cout << "Cost maps written to " << options.imageName << "_cost_*\n";
+	return success;
+}
+
+void CostMap::report() const
+{
+	std::vector<float> sorted = cycleCounts;
+	std::sort(sorted.begin(), sorted.end(), std::greater<float>());
+	double total = 0;
+	for (float value : sorted)
+		total += value;
+	if (total <= 0)
+		return;
+	auto share = [&](size_t percent) {
+		double sum = 0;
+		for (size_t i = 0; i < std::max<size_t>(1, sorted.size() * percent / 100); i++)
+			sum += sorted[i];
+		return 100 * sum / total;
+	};
+#ifdef COST_MAP_USE_RDTSC
+	const char* unit = "cycles";
+#else
+	const char* unit = "time";
+#endif
+	std::cout << std::fixed << std::setprecision(1) << "Cost map: most costly 1% of pixels take " << share(1)
+		<< "% of " << unit << ", 10% take " << share(10) << "%\n";
+}
@@ -0,0 +1,158 @@
+// Render cost estimate of a loaded scene, made by tracing a small part of its pixels
+#include "estimate.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <unordered_set>
+#include <algorithm>
+#include <cmath>
+
+#include "scene.h"
+#include "timer.h"
+#include "thread_pool.h"
+
+namespace
+{
+	uint32_t hashCell(uint32_t x, uint32_t y)
+	{
+		uint32_t h = x * 0x8da6b343u ^ y * 0xd8163841u;
+		h ^= h >> 16; h *= 0x7feb352du;
+		h ^= h >> 15; h *= 0x846ca68bu;
+		h ^= h >> 16;
+		return h;
+	}
+
+	double megabytes(size_t bytes)
+	{
+		return bytes / (1024.0 * 1024.0);
+	}
+}
+
+RenderEstimate estimateRender(Scene& scene, double fraction)
+{
+	RenderEstimate estimate;
+	estimate.memory = estimateMemory(scene);
+
+	// Sample is traced with statistics and one worker per pool thread, so that
+	// time of a worker is time of one core. Render context keeps its own copy of options
+	const Options saved = scene.options;
+	scene.options.collectStatistics = true;
+	scene.options.outputProgress = false;
+	scene.options.nWorkers = (int)std::max<size_t>(1, scene.workerPool().size());
+	RenderContext ctx(scene);
+	scene.options = saved;
+	const Options& options = ctx.options;
+
+	// Every cell of cellSize x cellSize pixels gets one pixel
+	const size_t cellSize = std::max<size_t>(1, (size_t)std::lround(std::sqrt(1 / std::max(fraction, 1e-6))));
+	const size_t cellsX = (options.width + cellSize - 1) / cellSize;
+	const size_t cellsY = (options.height + cellSize - 1) / cellSize;
+	const size_t nWorkers = (size_t)options.nWorkers;
+	std::vector<double> busy(nWorkers, 0);
+
+	const size_t rays = ctx.stats.raysCasted;
+	size_t raysByType[4];
+	for (int i = 0; i < 4; i++)
+		raysByType[i] = ctx.stats.raysByType[i];
+
+	Timer t("Sample", false);
+	ctx.launchWorkers([&](size_t worker, TraceState& state) {
+		auto start = std::chrono::steady_clock::now();
+		for (size_t cellY = worker; cellY < cellsY; cellY += nWorkers) {
+			for (size_t cellX = 0; cellX < cellsX; cellX++) {
+				const uint32_t hash = hashCell((uint32_t)cellX, (uint32_t)cellY);
+				const size_t x = cellX * cellSize + (hash & 0xffff) % std::min(cellSize, options.width - cellX * cellSize);
+				const size_t y = cellY * cellSize + (hash >> 16) % std::min(cellSize, options.height - cellY * cellSize);
+				ctx.renderPixel(x, y, state);
+			}
+		}
+		busy[worker] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	});
+	estimate.sampleTime = t.stop();
+	estimate.sampledPixels = cellsX * cellsY;
+
+	// Sample is scaled by ratio of pixels
+	const double scale = (double)(options.width * options.height) / estimate.sampledPixels;
+	for (double time : busy)
+		estimate.cpuTime += time * scale;
+	estimate.rays = (size_t)((ctx.stats.raysCasted - rays) * scale);
+	for (int i = 0; i < 4; i++)
+		estimate.raysByType[i] = (size_t)((ctx.stats.raysByType[i] - raysByType[i]) * scale);
+	return estimate;
+}
+
+MemoryEstimate estimateMemory(const Scene& scene)
+{
+	// Geometry and maps shared by several meshes are counted once
+	MemoryEstimate memory;
+	std::unordered_set<const void*> seen;
+	for (const auto& object : scene.objects) {
+		if (object->objectType != ObjectType::Mesh)
+			continue;
+		const Mesh& mesh = static_cast<const Mesh&>(*object);
+		memory.triangles += mesh.restTris.capacity() * sizeof(Triangle);
+		if (mesh.geometry && seen.insert(mesh.geometry.get()).second) {
+			memory.triangles += mesh.geometry->tris.size() * (sizeof(Triangle) + sizeof(const Triangle*));
+			if (mesh.geometry->ac)
+				memory.treeNodes += mesh.geometry->ac->memorySize();
+		}
+		if (mesh.diffuseMap && seen.insert(mesh.diffuseMap.get()).second)
+			memory.textures += mesh.diffuseMap->memorySize();
+		if (mesh.normalMap && seen.insert(mesh.normalMap.get()).second)
+			memory.textures += mesh.normalMap->memorySize();
+		if (mesh.specularMap && seen.insert(mesh.specularMap.get()).second)
+			memory.textures += mesh.specularMap->memorySize();
+	}
+
+	const Options& options = scene.options;
+	if (options.useSkybox && scene.skyboxes[0])
+		memory.textures += 6 * (size_t)scene.skyboxWidth * scene.skyboxHeight * sizeof(Vec3f);
+	const size_t tileSize = std::max(1, options.tileSize);
+	if (options.tiledFramebuffer && !options.progressive && !options.showAC)
+		memory.frameBuffer = std::max(1, options.nWorkers) * tileSize * tileSize * sizeof(Vec3f);
+	else
+		memory.frameBuffer = options.width * options.height * sizeof(Vec3f);
+	return memory;
+}
+
+int runEstimate(const std::string& scenePath, size_t workers)
+{
+	Scene scene;
+	Timer loadTimer("Loading", false);
+	scene.sceneLoadSuccess = scene.loadScene(scenePath);
+	const long long loadTime = loadTimer.stop();
+	if (!scene.sceneLoadSuccess)
+		return 1;
+	if (workers == 0)
+		workers = std::max(1, scene.options.nWorkers);
+	if (scene.animation.enabled())
+		scene.setFrame(scene.animation.firstFrame);
+
+	const RenderEstimate estimate = estimateRender(scene);
+	const Options& options = scene.options;
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "Estimate of " << scenePath << ", " << options.width << "x" << options.height << '\n';
+	std::cout << "Scene loaded in " << loadTime << " ms, " << estimate.sampledPixels << " pixels traced in "
+		<< estimate.sampleTime << " ms\n";
+	std::cout << std::scientific << std::setprecision(2);
+	std::cout << "Rays:            " << (double)estimate.rays << '\n';
+	std::cout << "  camera:        " << (double)estimate.raysByType[(int)RayType::PrimaryRay] << '\n';
+	std::cout << "  shadow:        " << (double)estimate.raysByType[(int)RayType::ShadowRay] << '\n';
+	std::cout << "  reflection:    " << (double)estimate.raysByType[(int)RayType::ReflectionRay] << '\n';
+	std::cout << "  refraction:    " << (double)estimate.raysByType[(int)RayType::RefractionRay] << '\n';
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "CPU time:        " << estimate.cpuTime / 1000 << " s\n";
+	std::cout << "Render time:     " << estimate.renderTime(workers) / 1000 << " s with " << workers << " workers\n";
+	if (scene.animation.enabled()) {
+		const int frames = scene.animation.lastFrame - scene.animation.firstFrame + 1;
+		std::cout << "Animation:       " << estimate.renderTime(workers) * frames / 1000 << " s for "
+			<< frames << " frames as costly as the first one\n";
+	}
+	std::cout << "Memory:          " << megabytes(estimate.memory.total()) << " MB\n";
+	std::cout << "  triangles:     " << megabytes(estimate.memory.triangles) << " MB\n";
+	std::cout << "  tree nodes:    " << megabytes(estimate.memory.treeNodes) << " MB\n";
+	std::cout << "  textures:      " << megabytes(estimate.memory.textures) << " MB\n";
+	std::cout << "  frame buffer:  " << megabytes(estimate.memory.frameBuffer) << " MB\n";
+	return 0;
+}
@@ -0,0 +1,316 @@
+// Image output: BMP, binary PPM and float PFM, written tile by tile
+#include "image.h"
+
+#ifdef _WIN32
+	#define NOMINMAX
+	#include "windows.h"
+	#include "shellapi.h"
+#else
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif // _WIN32
+
+#if defined(__SSE2__) || defined(_M_X64)
+	#include <emmintrin.h>
+	#define IMAGE_USE_SSE2
+#endif
+
+#include <vector>
+#include <thread>
+#include <cstring>
+#include <cstdint>
+#include <filesystem>
+
+#include "util.h"
+#include "profiler.h"
+
+static_assert(sizeof(Vec3f) == 3 * sizeof(float), "frame buffer is read as packed floats");
+
+namespace
+{
+	void putUInt32(char* dst, uint32_t value)
+	{
+		for (int i = 0; i < 4; i++)
+			dst[i] = (char)((value >> (8 * i)) & 0xff);
+	}
+
+	size_t bytesPerPixel(ImageFormat format)
+	{
+		return format == ImageFormat::PFM ? 3 * sizeof(float) : 3;
+	}
+}
+
+ImageWriter::ImageWriter(const std::string& a_path, size_t a_width, size_t a_height, ImageFormat a_format)
+	: path(a_path), width(a_width), height(a_height), format(a_format)
+{
+	std::string header;
+	if (format == ImageFormat::BMP) {
+		// Rows are stored bottom-up and padded to 4 bytes
+		rowSize = (width * 3 + 3) & ~(size_t)3;
+		char bmpHeader[54] = { 0 };
+		memcpy(bmpHeader, "BM", 2);
+		putUInt32(bmpHeader + 0x2, (uint32_t)(54 + rowSize * height));
+		putUInt32(bmpHeader + 0xA, 54);
+		putUInt32(bmpHeader + 0xE, 40);
+		putUInt32(bmpHeader + 0x12, (uint32_t)width);
+		putUInt32(bmpHeader + 0x16, (uint32_t)height);
+		bmpHeader[0x1A] = 1;
+		bmpHeader[0x1C] = 24;
+		putUInt32(bmpHeader + 0x22, (uint32_t)(rowSize * height));
+		putUInt32(bmpHeader + 0x26, 2835);
+		putUInt32(bmpHeader + 0x2A, 2835);
+		header.assign(bmpHeader, sizeof(bmpHeader));
+	}
+	else if (format == ImageFormat::PPM) {
+		rowSize = width * 3;
+		header = "P6\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n255\n";
+	}
+	else {
+		// Negative scale means little-endian floats, rows are stored bottom-up
+		rowSize = width * 3 * sizeof(float);
+		header = "PF\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n-1.0\n";
+	}
+	headerSize = header.size();
+	if (format == ImageFormat::BMP && headerSize + rowSize * height > UINT32_MAX) {
+		std::cout << "Image is too large for BMP format: " << path << '\n';
+		return;
+	}
+
+#ifdef _WIN32
+	file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.good())
+		return;
+	file.write(header.data(), header.size());
+
+	// Reserve the whole file, so that tiles can be written at their offsets
+	if (rowSize * height > 0) {
+		file.seekp(headerSize + rowSize * height - 1);
+		file.put(0);
+	}
+	opened = file.good();
+#else
+	fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return;
+
+	// Blocks are allocated up front, so that full disk is reported here instead
+	// of as a fault on first write to the mapping
+	fileSize = headerSize + rowSize * height;
+	if (posix_fallocate(fd, 0, fileSize) != 0 && ftruncate(fd, fileSize) != 0)
+		return;
+	void* mapping = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mapping == MAP_FAILED)
+		return;
+	data = static_cast<char*>(mapping);
+	memcpy(data, header.data(), headerSize);
+	rowPixels.reset(new std::atomic<size_t>[height]());
+	opened = true;
+#endif
+}
+
+ImageWriter::~ImageWriter()
+{
+	close();
+#ifndef _WIN32
+	if (fd >= 0)
+		::close(fd);
+#endif
+}
+
+const char* ImageWriter::extension(ImageFormat format)
+{
+	if (format == ImageFormat::PPM)
+		return "ppm";
+	if (format == ImageFormat::PFM)
+		return "pfm";
+	return "bmp";
+}
+
+size_t ImageWriter::dataSize(size_t width, size_t height, ImageFormat format)
+{
+	if (format == ImageFormat::BMP)
+		return ((width * 3 + 3) & ~(size_t)3) * height;
+	return width * bytesPerPixel(format) * height;
+}
+
+size_t ImageWriter::rowOffset(size_t y) const
+{
+	if (format == ImageFormat::PPM)
+		return headerSize + y * rowSize;
+	return headerSize + (height - 1 - y) * rowSize;
+}
+
+void ImageWriter::writeTile(const Vec3f* pixels, size_t stride, size_t x0, size_t y0, size_t x1, size_t y1)
+{
+	PROFILE_ZONE("Write tile");
+	if (!opened || x1 <= x0 || y1 <= y0)
+		return;
+
+#ifndef _WIN32
+	// Rows of tiles never overlap, so threads write to mapping without locking
+	for (size_t y = y0; y < y1; y++) {
+		const Vec3f* src = pixels + (y - y0) * stride;
+		char* dst = data + rowOffset(y) + x0 * bytesPerPixel(format);
+		if (format == ImageFormat::PFM)
+			memcpy(dst, src, (x1 - x0) * bytesPerPixel(format));
+		else
+			quantizeRow(src, x1 - x0, (unsigned char*)dst, format == ImageFormat::BMP);
+	}
+
+	// Release runs of rows completed by this tile
+	size_t runStart = y1;
+	for (size_t y = y0; y <= y1; y++) {
+		const bool complete = y < y1 && (rowPixels[y] += x1 - x0) == width;
+		if (complete && runStart == y1)
+			runStart = y;
+		if (!complete && runStart != y1) {
+			releaseRows(runStart, y);
+			runStart = y1;
+		}
+	}
+#else
+	// Convert tile before taking the lock, so that only file access is serialized
+	const size_t tileRowSize = (x1 - x0) * bytesPerPixel(format);
+	std::vector<unsigned char> data(tileRowSize * (y1 - y0));
+	for (size_t y = y0; y < y1; y++) {
+		const Vec3f* src = pixels + (y - y0) * stride;
+		unsigned char* dst = data.data() + (y - y0) * tileRowSize;
+		if (format == ImageFormat::PFM)
+			memcpy(dst, src, tileRowSize);
+		else
+			quantizeRow(src, x1 - x0, dst, format == ImageFormat::BMP);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t y = y0; y < y1; y++) {
+		file.seekp(rowOffset(y) + x0 * bytesPerPixel(format));
+		file.write((const char*)data.data() + (y - y0) * tileRowSize, tileRowSize);
+	}
+	if (!file.good())
+		failed = true;
+#endif
+}
+
+void ImageWriter::releaseRows(size_t y0, size_t y1)
+{
+#ifndef _WIN32
+	if (!opened || y1 <= y0)
+		return;
+
+	// Byte range of rows, shrunk to whole pages, as pages on its edges are shared
+	// with rows that may still be written
+	size_t begin = std::min(rowOffset(y0), rowOffset(y1 - 1));
+	size_t end = std::max(rowOffset(y0), rowOffset(y1 - 1)) + rowSize;
+	const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	begin = (begin + pageSize - 1) / pageSize * pageSize;
+	end = end / pageSize * pageSize;
+	if (begin < end) {
+		// Dirty pages stay in page cache and are written back by the kernel
+		madvise(data + begin, end - begin, MADV_DONTNEED);
+	}
+#endif
+}
+
+bool ImageWriter::close()
+{
+	PROFILE_ZONE("Close image");
+#ifdef _WIN32
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!opened)
+		return false;
+	opened = false;
+	file.close();
+	return !failed && !file.fail();
+#else
+	if (!opened)
+		return false;
+	opened = false;
+	failed = munmap(data, fileSize) != 0 || failed;
+	data = nullptr;
+	failed = ::close(fd) != 0 || failed;
+	fd = -1;
+	return !failed;
+#endif
+}
+
+
+void quantizeRow(const Vec3f* pixels, size_t count, unsigned char* dst, bool bgr)
+{
+	const float* src = &pixels[0].x;
+	const size_t n = count * 3;
+	size_t i = 0;
+#ifdef IMAGE_USE_SSE2
+	// 16 channels at once: clamp, scale, truncate and pack with saturation
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(255.0f);
+	auto convert = [&](const float* p) {
+		return _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(p), zero), one), scale));
+	};
+	for (; i + 16 <= n; i += 16) {
+		__m128i lo = _mm_packs_epi32(convert(src + i), convert(src + i + 4));
+		__m128i hi = _mm_packs_epi32(convert(src + i + 8), convert(src + i + 12));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+#endif
+	for (; i < n; i++)
+		dst[i] = (unsigned char)(clamp(0.0f, 1.0f, src[i]) * 255);
+
+	if (bgr) {
+		for (size_t p = 0; p < n; p += 3)
+			std::swap(dst[p], dst[p + 2]);
+	}
+}
+
+std::string imagePath(const Options& options)
+{
+	return options.imageName + '.' + ImageWriter::extension(options.imageFormat);
+}
+
+int saveImage(Vec3f* frameBuffer, const Options& options)
+{
+	PROFILE_ZONE("Write image");
+	std::string path = imagePath(options);
+	ImageWriter writer(path, options.width, options.height, options.imageFormat);
+	if (!writer.good()) {
+		std::cout << "Could not open output file " << path << '\n';
+		return -1;
+	}
+
+	// Rows are converted and written in parallel bands
+	const size_t nThreads = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), options.height));
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < nThreads; i++) {
+		size_t y0 = options.height * i / nThreads;
+		size_t y1 = options.height * (i + 1) / nThreads;
+		threads.emplace_back([&writer, frameBuffer, &options, y0, y1]() {
+			writer.writeTile(frameBuffer + y0 * options.width, options.width, 0, y0, options.width, y1);
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	if (!writer.close()) {
+		std::cout << "Could not write output file " << path << '\n';
+		return -1;
+	}
+	if (options.enableOutput) {
+		std::cout << "Successfully wrote to output file " << path << '\n';
+	}
+	return 0;
+}
+
+void openImage(const std::string& path)
+{
+	std::string fullPath = (std::filesystem::current_path() / path).string();
+	#ifdef _WIN32
+		wchar_t* wPath = new wchar_t[strlen(fullPath.c_str()) + 1];
+		mbstowcs(wPath, fullPath.c_str(), strlen(fullPath.c_str()) + 1);
+		ShellExecute(NULL, L"open", wPath, NULL, NULL, SW_SHOWDEFAULT);
+		delete[] wPath;
+	#elif __linux__
+		auto linuxCmd = "xdg-open " + fullPath;
+		system(linuxCmd.c_str());
+	#endif
+}
@@ -1,15 +1,66 @@
-#include "scene.h"
-
-#include<iostream>
-
-int main(int argc, char** argv)
-{
-	std::string scenePath;
-	if (argc > 1) {
-		scenePath = argv[1];
-	}
-	else {
-		scenePath = std::string("input/simple_shapes.scene");
-	}
-	Scene(scenePath).render();
-}
+#include "scene.h"
+#include "server.h"
+#include "coordinator.h"
+#include "estimate.h"
+#include "profiler.h"
+
+#include<iostream>
+#include<cstring>
+#include<csignal>
+
+namespace
+{
+	std::atomic<bool> stopRender{ false };
+
+	void requestStop(int)
+	{
+		stopRender = true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	PROFILE_THREAD("Main thread");
+#ifndef _WIN32
+	// Daemon keeps loaded assets between jobs, client sends one job to it
+	if (argc > 2 && strcmp(argv[1], "--serve") == 0) {
+		const size_t cacheMegabytes = argc > 3 ? std::stoul(argv[3]) : 1024;
+		return RenderServer(argv[2], cacheMegabytes << 20).run();
+	}
+	if (argc > 2 && strcmp(argv[1], "--client") == 0)
+		return runClient(argv[2], std::vector<std::string>(argv + 3, argv + argc));
+	// Coordinator splits one frame between worker processes
+	if (argc > 3 && strcmp(argv[1], "--coordinate") == 0)
+		return runCoordinator(argv[0], argv[2], argv[3], argc > 4 ? std::stoul(argv[4]) : 2, argc > 5 ? std::stoul(argv[5]) : 60);
+	if (argc > 3 && strcmp(argv[1], "--tile-worker") == 0)
+		return runTileWorker(argv[2], argv[3], argc > 4 ? std::stoul(argv[4]) : 0);
+#endif // _WIN32
+	// Trace a small sample of pixels and print expected render time and memory
+	if (argc > 2 && strcmp(argv[1], "--estimate") == 0)
+		return runEstimate(argv[2], argc > 3 ? std::stoul(argv[3]) : 0);
+
+	// Resumed render continues from checkpoint of a stopped one
+	const bool resume = argc > 1 && strcmp(argv[1], "--resume") == 0;
+	std::string scenePath;
+	if (argc > 1 + resume) {
+		scenePath = argv[1 + resume];
+	}
+	else {
+		scenePath = std::string("input/simple_shapes.scene");
+	}
+	// Scene with animation block renders all its frames
+	Scene scene(scenePath);
+	if (resume) {
+		scene.options.checkpoint = true;
+		scene.options.resume = true;
+	}
+	// Checkpointed render is stopped by SIGTERM or SIGINT after tiles in flight,
+	// so that they are saved too
+	if (scene.options.checkpoint && !scene.animation.enabled()) {
+		scene.stop = &stopRender;
+		std::signal(SIGTERM, requestStop);
+		std::signal(SIGINT, requestStop);
+	}
+	long long time = scene.animation.enabled() ? scene.renderAnimation() : scene.render();
+	return time < 0 ? 1 : 0;
+}
@@ -0,0 +1,125 @@
+// Memory used by scene data and render buffers, by category and by asset
+#include "memory_tracker.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+	const char* const categoryNames[memoryCategoryCount] = {
+		"triangles", "tree nodes", "leaf arrays", "textures", "skybox", "frame buffer", "output buffer"
+	};
+
+	double megabytes(size_t bytes)
+	{
+		return bytes / (1024.0 * 1024.0);
+	}
+
+	size_t budgetBytes(size_t budget)
+	{
+		return budget * 1024 * 1024;
+	}
+}
+
+bool MemoryTracker::reserve(MemoryCategory category, const std::string& asset, size_t bytes, size_t budget)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (budget && total.current + bytes > budgetBytes(budget)) {
+		std::cout << std::fixed << std::setprecision(1) << "Memory budget of " << budget << " MB exceeded by " << asset
+			<< ", it needs " << megabytes(bytes) << " MB for " << categoryNames[(int)category] << " and "
+			<< megabytes(total.current) << " MB are in use\n" << std::defaultfloat;
+		return false;
+	}
+	add(category, asset, bytes);
+	return true;
+}
+
+void MemoryTracker::charge(MemoryCategory category, const std::string& asset, size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	add(category, asset, bytes);
+}
+
+void MemoryTracker::add(MemoryCategory category, const std::string& asset, size_t bytes)
+{
+	auto grow = [bytes](Usage& usage) {
+		usage.current += bytes;
+		usage.peak = std::max(usage.peak, usage.current);
+	};
+	grow(total);
+	grow(categories[(int)category]);
+	AssetUsage& usage = assets[asset];
+	grow(usage.total);
+	usage.current[(int)category] += bytes;
+}
+
+void MemoryTracker::release(MemoryCategory category, const std::string& asset, size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	total.current -= std::min(bytes, total.current);
+	Usage& usage = categories[(int)category];
+	usage.current -= std::min(bytes, usage.current);
+	auto found = assets.find(asset);
+	if (found != assets.end()) {
+		found->second.total.current -= std::min(bytes, found->second.total.current);
+		size_t& current = found->second.current[(int)category];
+		current -= std::min(bytes, current);
+	}
+}
+
+bool MemoryTracker::fits(const std::string& asset, size_t budget) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!budget || total.current <= budgetBytes(budget))
+		return true;
+	std::cout << std::fixed << std::setprecision(1) << "Memory budget of " << budget << " MB exceeded by " << asset
+		<< ", " << megabytes(total.current) << " MB are in use\n" << std::defaultfloat;
+	return false;
+}
+
+size_t MemoryTracker::current() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return total.current;
+}
+
+size_t MemoryTracker::peak() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return total.peak;
+}
+
+void MemoryTracker::print(size_t budget) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "Memory MB:                current      peak\n";
+	for (int i = 0; i < memoryCategoryCount; i++) {
+		std::cout << "  " << std::left << std::setw(20) << categoryNames[i] << std::right << std::setw(10)
+			<< megabytes(categories[i].current) << std::setw(10) << megabytes(categories[i].peak) << '\n';
+	}
+	std::cout << "  " << std::left << std::setw(20) << "total" << std::right << std::setw(10) << megabytes(total.current)
+		<< std::setw(10) << megabytes(total.peak);
+	if (budget)
+		std::cout << " of " << budget << " budget";
+	std::cout << '\n';
+
+	// Assets by peak usage, with the categories they currently use
+	std::vector<std::pair<std::string, AssetUsage>> ranked(assets.begin(), assets.end());
+	std::stable_sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) {
+		return a.second.total.peak > b.second.total.peak;
+	});
+	std::cout << "Memory MB by asset:       current      peak\n";
+	for (const auto& [asset, usage] : ranked) {
+		const std::string name = asset.size() > 20 ? "..." + asset.substr(asset.size() - 17) : asset;
+		std::cout << "  " << std::left << std::setw(20) << name << std::right << std::setw(10)
+			<< megabytes(usage.total.current) << std::setw(10) << megabytes(usage.total.peak) << " ";
+		for (int i = 0; i < memoryCategoryCount; i++)
+			if (usage.current[i])
+				std::cout << ' ' << categoryNames[i] << ' ' << megabytes(usage.current[i]);
+		std::cout << '\n';
+	}
+	std::cout << std::defaultfloat;
+}
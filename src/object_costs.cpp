@@ -0,0 +1,103 @@
+// Render cost attributed to objects of the scene and to material types
+#include "object_costs.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <numeric>
+#include <filesystem>
+
+#include "compiled_scene.h"
+
+namespace
+{
+	const char* const objectTypeNames[4] = { "object", "sphere", "plane", "mesh" };
+	const char* const materialTypeNames[4] = { "diffuse", "reflective", "transparent", "phong" };
+
+	void addCost(ObjectCost& to, const ObjectCost& from)
+	{
+		to.intersectCycles += from.intersectCycles;
+		to.shadeCycles += from.shadeCycles;
+		to.triangleTests += from.triangleTests;
+		to.boxTests += from.boxTests;
+		to.hits += from.hits;
+	}
+
+	double share(uint64_t part, uint64_t total)
+	{
+		return total ? 100.0 * part / total : 0.0;
+	}
+
+	void printHeader(const char* title)
+	{
+		std::cout << std::left << std::setw(38) << title << std::right << std::setw(9) << "intersect" << std::setw(9)
+			<< "shade" << std::setw(9) << "total" << std::setw(13) << "tri tests" << std::setw(13) << "box tests"
+			<< std::setw(11) << "hits" << '\n';
+	}
+
+	void printRow(const ObjectCost& cost, uint64_t total)
+	{
+		std::cout << std::setw(8) << share(cost.intersectCycles, total) << '%' << std::setw(8)
+			<< share(cost.shadeCycles, total) << '%' << std::setw(8)
+			<< share(cost.intersectCycles + cost.shadeCycles, total) << '%' << std::setw(13)
+			<< cost.triangleTests << std::setw(13) << cost.boxTests << std::setw(11) << cost.hits << '\n';
+	}
+}
+
+void ObjectCosts::add(const WorkerCosts& worker)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t i = 0; i < objects.size() && i < worker.objects.size(); i++)
+		addCost(objects[i], worker.objects[i]);
+}
+
+void ObjectCosts::add(const ObjectCosts& other)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t i = 0; i < objects.size() && i < other.objects.size(); i++)
+		addCost(objects[i], other.objects[i]);
+}
+
+void ObjectCosts::report(const CompiledScene& scene) const
+{
+	uint64_t total = 0;
+	for (const ObjectCost& cost : objects)
+		total += cost.intersectCycles + cost.shadeCycles;
+
+	std::vector<size_t> ranked(objects.size());
+	std::iota(ranked.begin(), ranked.end(), 0);
+	std::stable_sort(ranked.begin(), ranked.end(), [&](size_t a, size_t b) {
+		return objects[a].intersectCycles + objects[a].shadeCycles > objects[b].intersectCycles + objects[b].shadeCycles;
+	});
+
+	std::cout << std::fixed << std::setprecision(1);
+	printHeader("Cost by object:");
+	for (size_t i : ranked) {
+		// Meshes are shown by their file name, other objects by type
+		const ObjectRecord& record = scene.objects[i];
+		const Mesh* mesh = record.type == ObjectType::Mesh ? static_cast<const Mesh*>(record.object) : nullptr;
+		std::string name = mesh && !mesh->name.empty() ? std::filesystem::path(mesh->name).filename().string()
+			: objectTypeNames[(int)record.type];
+		name = '#' + std::to_string(i) + ' ' + name;
+		if (name.size() > 24)
+			name = name.substr(0, 21) + "...";
+		std::cout << "  " << std::left << std::setw(24) << name << ' ' << std::setw(11)
+			<< materialTypeNames[(int)scene.materials[record.material].type] << std::right;
+		printRow(objects[i], total);
+	}
+
+	ObjectCost byMaterial[4];
+	for (size_t i = 0; i < objects.size(); i++)
+		addCost(byMaterial[(int)scene.materials[scene.objects[i].material].type], objects[i]);
+	printHeader("Cost by material:");
+	for (int type = 0; type < 4; type++) {
+		std::cout << "  " << std::left << std::setw(36) << materialTypeNames[type] << std::right;
+		printRow(byMaterial[type], total);
+	}
+#ifdef COST_MAP_USE_RDTSC
+	const char* unit = "cycles";
+#else
+	const char* unit = "ns";
+#endif
+	std::cout << "Attributed " << total / 1e6 << " M" << unit << " to intersection and shading\n" << std::defaultfloat;
+}
@@ -0,0 +1,616 @@
+// Single pass scene file parser
+#include "parser.h"
+
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+
+#include "scene.h"
+#include "util.h"
+#include "options.h"
+#include "thread_pool.h"
+#include "asset_cache.h"
+
+namespace
+{
+	std::string_view trim(std::string_view str)
+	{
+		while (!str.empty() && (str.front() == ' ' || str.front() == '\t'))
+			str.remove_prefix(1);
+		while (!str.empty() && (str.back() == ' ' || str.back() == '\t' || str.back() == '\r'))
+			str.remove_suffix(1);
+		return str;
+	}
+
+	bool startsWith(std::string_view str, std::string_view prefix)
+	{
+		return str.substr(0, prefix.size()) == prefix;
+	}
+
+	// Cache key of file asset, file changed on disk gets a new key
+	std::string assetKey(const char* kind, const std::string& path)
+	{
+		std::error_code error;
+		const auto modified = std::filesystem::last_write_time(path, error);
+		return std::string(kind) + ':' + path + '|' + std::to_string(error ? 0 : modified.time_since_epoch().count());
+	}
+
+	// Mesh key also holds everything loaded triangles and their tree depend on
+	std::string meshKey(const std::string& path, const Mesh& mesh, const Options& options)
+	{
+		char transform[256];
+		snprintf(transform, sizeof(transform), "|%a,%a,%a|%a,%a,%a|%a,%a,%a|%d,%d,%a",
+			mesh.pos.x, mesh.pos.y, mesh.pos.z, mesh.size.x, mesh.size.y, mesh.size.z,
+			mesh.rot.x, mesh.rot.y, mesh.rot.z, options.acPenalty, (int)options.useAC, options.bias);
+		return assetKey("mesh", path) + transform;
+	}
+
+	// Asset from cache, loaded directly if scene has no cache
+	template<typename T, typename Load>
+	std::shared_ptr<T> loadAsset(AssetCache* cache, const std::string& key, Load&& load)
+	{
+		return cache ? cache->get<T>(key, load) : load();
+	}
+
+	// Texture map from cache or file, charged to memory of the scene either way. Map
+	// loaded from file is charged before it is loaded, its size is read from file header
+	template<typename T, typename Load>
+	std::shared_ptr<T> loadTexture(AssetCache* cache, const std::string& key, Stats& stats, size_t budget,
+		const std::string& path, Load&& load)
+	{
+		using Texel = typename decltype(T::texels)::value_type;
+		bool loaded = false;
+		std::shared_ptr<T> map = loadAsset<T>(cache, key, [&]() -> std::shared_ptr<T> {
+			loaded = true;
+			int width = 0, height = 0;
+			const size_t bytes = readBMPSize(path.c_str(), width, height) ? (size_t)std::abs(width) * std::abs(height) * sizeof(Texel) : 0;
+			if (!stats.memory.reserve(MemoryCategory::Textures, path, bytes, budget))
+				return nullptr;
+			std::shared_ptr<T> loadedMap = load(path);
+			if (!loadedMap)
+				stats.memory.release(MemoryCategory::Textures, path, bytes);
+			return loadedMap;
+		});
+		if (map && !loaded && !stats.memory.reserve(MemoryCategory::Textures, path, map->texels.size() * sizeof(Texel), budget))
+			return nullptr;
+		return map;
+	}
+}
+
+ParseError::ParseError(const std::string& message, size_t a_line, size_t a_column)
+	: std::runtime_error(message), line(a_line), column(a_column) {}
+
+
+SceneParser::SceneParser(Scene& a_scene, ThreadPool& a_loaders, std::vector<std::future<bool>>& a_pendingLoads)
+	: scene(a_scene), loaders(a_loaders), pendingLoads(a_pendingLoads) {}
+
+bool SceneParser::parse(const std::string& scenePath)
+{
+	MappedFile file(scenePath);
+	if (!file.good()) {
+		std::cout << "Could not open scene file: " << scenePath << '\n';
+		return false;
+	}
+
+	return parseText(file.view(), scenePath);
+}
+
+bool SceneParser::parseText(std::string_view text, const std::string& name)
+{
+	scene.sourceHash = hashKey(text);
+	try {
+		parseLines(text);
+	}
+	catch (const ParseError& e) {
+		std::cout << name << ':' << e.line << ':' << e.column << ": error: " << e.what() << '\n';
+		// Scheduled loads may still use entity of the current block
+		for (auto& load : pendingLoads)
+			load.wait();
+		return false;
+	}
+	return true;
+}
+
+void SceneParser::parseLines(std::string_view text)
+{
+	bool skipBlock = false;
+	size_t pos = 0;
+	while (pos < text.size()) {
+		size_t end = text.find('\n', pos);
+		if (end == std::string_view::npos)
+			end = text.size();
+		std::string_view line = text.substr(pos, end - pos);
+		lineStart = line.data();
+		lineNumber++;
+		pos = end + 1;
+
+		// Commented block is skipped until the next block header
+		line = trim(line);
+		if (startsWith(line, "#[")) {
+			finishBlock();
+			blockType = BlockType::None;
+			skipBlock = true;
+			continue;
+		}
+
+		// Skip comments
+		size_t comment = line.find('#');
+		if (comment != std::string_view::npos)
+			line = trim(line.substr(0, comment));
+		if (line.empty())
+			continue;
+
+		// Select block
+		if (line.front() == '[') {
+			finishBlock();
+			skipBlock = false;
+			selectBlock(line);
+			if (blockType == BlockType::None)
+				return;
+			continue;
+		}
+		if (skipBlock)
+			continue;
+
+		// Parse the line
+		size_t separator = line.find('=');
+		if (separator == std::string_view::npos)
+			error("expected key=value", line);
+		std::string_view key = trim(line.substr(0, separator));
+		std::string_view value = trim(line.substr(separator + 1));
+
+		if (blockType == BlockType::Options)
+			parseOption(key, value);
+		else if (blockType == BlockType::Light)
+			parseLight(key, value);
+		else if (blockType == BlockType::Object)
+			parseObject(key, value);
+		else if (blockType == BlockType::Animation)
+			parseAnimation(key, value);
+		else
+			error("key outside of block", key);
+	}
+
+	// File may end without end block
+	finishBlock();
+}
+
+void SceneParser::selectBlock(std::string_view header)
+{
+	blockLineNumber = lineNumber;
+	switch (hashKey(header)) {
+	case hashKey("[options]"):
+		blockType = BlockType::Options;
+		break;
+	case hashKey("[light]"):
+		blockType = BlockType::Light;
+		break;
+	case hashKey("[object]"):
+		blockType = BlockType::Object;
+		break;
+	case hashKey("[animation]"):
+		blockType = BlockType::Animation;
+		break;
+	case hashKey("[end]"):
+		blockType = BlockType::None;
+		break;
+	default:
+		error("unknown block " + std::string(header), header);
+	}
+}
+
+void SceneParser::finishBlock()
+{
+	if (blockType == BlockType::Light) {
+		if (!light)
+			throw ParseError("light block has no type", blockLineNumber, 1);
+		scene.addLight(std::move(light));
+	}
+	else if (blockType == BlockType::Object) {
+		if (!object)
+			throw ParseError("object block has no type", blockLineNumber, 1);
+
+		// Mesh is loaded once block is finished, so that its
+		// position, size and rotation are already known
+		if (object->objectType == ObjectType::Mesh) {
+			if (meshPath.empty())
+				throw ParseError("mesh object has no name", blockLineNumber, 1);
+			// Loader gets a copy of options, as parser may still change them. Cached
+			// geometry is shared, mesh copies it only if it is moved
+			Mesh* mesh = static_cast<Mesh*>(object.get());
+			mesh->name = meshPath;
+			Stats* stats = &scene.stats;
+			AssetCache* cache = scene.assets;
+			const std::string key = cache ? meshKey(meshPath, *mesh, scene.options) : std::string();
+			pendingLoads.push_back(loaders.submit([mesh, stats, cache, key, options = scene.options, path = meshPath]() {
+				bool loaded = false;
+				mesh->geometry = loadAsset<MeshGeometry>(cache, key, [&]() {
+					loaded = mesh->loadOBJ(path, options, *stats);
+					return loaded ? mesh->geometry : nullptr;
+				});
+				// Geometry from cache is charged to this scene as well
+				if (mesh->geometry && !loaded && !mesh->geometry->reserveMemory(*stats, options.memoryBudget))
+					mesh->geometry.reset();
+				if (mesh->geometry && !loaded && options.collectStatistics)
+					stats->meshCount += mesh->geometry->tris.size();
+				return mesh->geometry != nullptr;
+			}));
+			meshPath.clear();
+		}
+		scene.addObject(std::move(object));
+	}
+}
+
+void SceneParser::parseOption(std::string_view key, std::string_view value)
+{
+	Options& options = scene.options;
+	switch (hashKey(key)) {
+	case hashKey("outputProgress"):		options.outputProgress = toBool(value); break;
+	case hashKey("useBackfaceCulling"):	options.useBackfaceCulling = toBool(value); break;
+	case hashKey("collectStatistics"):	options.collectStatistics = toBool(value); break;
+	case hashKey("enableOutput"):		options.enableOutput = toBool(value); break;
+	case hashKey("imageOutput"):		options.imageOutput = toBool(value); break;
+	case hashKey("openImage"):			options.openImage = toBool(value); break;
+	case hashKey("useAC"):				options.useAC = toBool(value); break;
+	case hashKey("showAC"):				options.showAC = toBool(value); break;
+	case hashKey("useSkybox"):			options.useSkybox = toBool(value); break;
+	case hashKey("useTextures"):		options.useTextures = toBool(value); break;
+	case hashKey("showNormals"):		options.showNormals = toBool(value); break;
+	case hashKey("progressive"):		options.progressive = toBool(value); break;
+	case hashKey("antialiasing"):		options.antialiasing = toBool(value); break;
+	case hashKey("tiledFramebuffer"):	options.tiledFramebuffer = toBool(value); break;
+	case hashKey("costMap"):			options.costMap = toBool(value); break;
+	case hashKey("objectCosts"):		options.objectCosts = toBool(value); break;
+	case hashKey("perfCounters"):		options.perfCounters = toBool(value); break;
+	case hashKey("memoryReport"):		options.memoryReport = toBool(value); break;
+	case hashKey("width"):				options.width = toInt(value); break;
+	case hashKey("height"):				options.height = toInt(value); break;
+	case hashKey("fov"):				scene.camera.fov = toFloat(value); break;
+	case hashKey("image_name"):			options.imageName = std::string(value); break;
+	case hashKey("n_workers"):			options.nWorkers = toInt(value); break;
+	case hashKey("max_ray_depth"):		options.maxRayDepth = toInt(value); break;
+	case hashKey("ac_penalty"):			options.acPenalty = toInt(value); break;
+	case hashKey("ac_rebuild_threshold"):	options.acRebuildThreshold = toFloat(value); break;
+	case hashKey("progressive_step"):	options.progressiveStep = toInt(value); break;
+	case hashKey("progressive_interval"): options.progressiveInterval = toInt(value); break;
+	case hashKey("checkpoint"):			options.checkpoint = toBool(value); break;
+	case hashKey("checkpoint_interval"): options.checkpointInterval = toInt(value); break;
+	case hashKey("time_budget"):		options.timeBudget = toInt(value); break;
+	case hashKey("memory_budget"):		options.memoryBudget = toInt(value); break;
+	case hashKey("aa_min_samples"):		options.aaMinSamples = toInt(value); break;
+	case hashKey("aa_max_samples"):		options.aaMaxSamples = toInt(value); break;
+	case hashKey("aa_threshold"):		options.aaThreshold = toFloat(value); break;
+	case hashKey("aa_filter_width"):	options.aaFilterWidth = toFloat(value); break;
+	case hashKey("tile_size"):			options.tileSize = toInt(value); break;
+	case hashKey("image_format"):
+		switch (hashKey(value)) {
+		case hashKey("bmp"):	options.imageFormat = ImageFormat::BMP; break;
+		case hashKey("ppm"):	options.imageFormat = ImageFormat::PPM; break;
+		case hashKey("pfm"):	options.imageFormat = ImageFormat::PFM; break;
+		default:				error("unknown image format, expected bmp, ppm or pfm", value);
+		}
+		break;
+	case hashKey("sampler"):
+		switch (hashKey(value)) {
+		case hashKey("regular"):	options.samplerType = SamplerType::Regular; break;
+		case hashKey("r2"):			options.samplerType = SamplerType::R2; break;
+		case hashKey("sobol"):		options.samplerType = SamplerType::Sobol; break;
+		case hashKey("bluenoise"):	options.samplerType = SamplerType::BlueNoise; break;
+		default:					error("unknown sampler, expected regular, r2, sobol or bluenoise", value);
+		}
+		break;
+	case hashKey("aa_filter"):
+		switch (hashKey(value)) {
+		case hashKey("box"):		options.aaFilter = FilterType::Box; break;
+		case hashKey("tent"):		options.aaFilter = FilterType::Tent; break;
+		case hashKey("gaussian"):	options.aaFilter = FilterType::Gaussian; break;
+		default:					error("unknown filter, expected box, tent or gaussian", value);
+		}
+		break;
+	case hashKey("background_color"):	options.backgroundColor = toVec3(value); break;
+	case hashKey("position"):			scene.camera.pos = toVec3(value); break;
+	case hashKey("rotation"):			scene.camera.rot = toVec3(value); break;
+	case hashKey("skyboxes"): {
+		size_t start = 0;
+		for (int i = 0; i < 6; i++) {
+			size_t end = i < 5 ? value.find(',', start) : value.size();
+			if (end == std::string_view::npos)
+				error("expected 6 skybox names", value);
+			std::string_view name = trim(value.substr(start, end - start));
+			if (name.size() >= sizeof(options.names[i]))
+				error("skybox name is too long", name);
+			memcpy(options.names[i], name.data(), name.size());
+			options.names[i][name.size()] = 0;
+			start = end + 1;
+		}
+		options.useSkybox = 1;
+		break;
+	}
+	default:
+		std::cout << "Scene, unknown key: " << key << " at line " << lineNumber << '\n';
+	}
+}
+
+void SceneParser::parseLight(std::string_view key, std::string_view value)
+{
+	if (hashKey(key) == hashKey("type")) {
+		switch (hashKey(value)) {
+		case hashKey("distant"):	light = std::make_unique<DistantLight>(); break;
+		case hashKey("point"):		light = std::make_unique<PointLight>(); break;
+		case hashKey("area"):		light = std::make_unique<AreaLight>(); break;
+		default:					error("unknown light type", value);
+		}
+		return;
+	}
+	if (!light)
+		error("light type must be set before other properties", key);
+
+	auto expectType = [this, key](LightType type) {
+		if (light->type != type)
+			error("property " + std::string(key) + " is not valid for this light type", key);
+	};
+
+	switch (hashKey(key)) {
+	case hashKey("color"):
+		light->color = toVec3(value);
+		break;
+	case hashKey("intensity"):
+		light->intensity = toFloat(value);
+		break;
+	case hashKey("direction"):
+		expectType(LightType::DistantLight);
+		static_cast<DistantLight*>(light.get())->dir = toVec3(value);
+		break;
+	case hashKey("position"):
+		expectType(LightType::PointLight);
+		static_cast<PointLight*>(light.get())->pos = toVec3(value);
+		break;
+	case hashKey("pos"):
+		expectType(LightType::AreaLight);
+		static_cast<AreaLight*>(light.get())->pos = toVec3(value);
+		break;
+	case hashKey("i"):
+		expectType(LightType::AreaLight);
+		static_cast<AreaLight*>(light.get())->i = toVec3(value);
+		break;
+	case hashKey("j"):
+		expectType(LightType::AreaLight);
+		static_cast<AreaLight*>(light.get())->j = toVec3(value);
+		break;
+	case hashKey("samples"):
+		expectType(LightType::AreaLight);
+		static_cast<AreaLight*>(light.get())->samples = toInt(value);
+		break;
+	default:
+		std::cout << "Scene, unknown light key: " << key << " at line " << lineNumber << '\n';
+	}
+}
+
+void SceneParser::parseObject(std::string_view key, std::string_view value)
+{
+	if (hashKey(key) == hashKey("type")) {
+		switch (hashKey(value)) {
+		case hashKey("plane"):	object = std::make_unique<Plane>(); break;
+		case hashKey("sphere"):	object = std::make_unique<Sphere>(); break;
+		case hashKey("mesh"):	object = std::make_unique<Mesh>(); break;
+		default:				error("unknown object type", value);
+		}
+		return;
+	}
+	if (!object)
+		error("object type must be set before other properties", key);
+
+	auto expectType = [this, key](ObjectType type) {
+		if (object->objectType != type)
+			error("property " + std::string(key) + " is not valid for this object type", key);
+	};
+
+	switch (hashKey(key)) {
+	case hashKey("color"):
+		object->color = toVec3(value);
+		break;
+	case hashKey("pos"):
+		object->pos = toVec3(value);
+		break;
+	case hashKey("material"): {
+		// Material name is followed by its comma separated parameters
+		size_t separator = value.find(',');
+		std::string_view name = value.substr(0, separator);
+		std::string_view params = separator == std::string_view::npos ? std::string_view() : value.substr(separator + 1);
+		auto nextParam = [this, &params, value]() {
+			if (params.empty())
+				error("material has too few parameters", value);
+			size_t end = params.find(',');
+			float result = toFloat(params.substr(0, end));
+			params = end == std::string_view::npos ? std::string_view() : params.substr(end + 1);
+			return result;
+		};
+
+		switch (hashKey(name)) {
+		case hashKey("diffuse"):
+			object->materialType = MaterialType::Diffuse;
+			break;
+		case hashKey("reflective"):
+			object->materialType = MaterialType::Reflective;
+			break;
+		case hashKey("transparent"):
+			object->materialType = MaterialType::Transparent;
+			object->indexOfRefraction = nextParam();
+			break;
+		case hashKey("phong"):
+			object->materialType = MaterialType::Phong;
+			object->ambient = nextParam();
+			object->diffuse = nextParam();
+			object->specular = nextParam();
+			object->nSpecular = nextParam();
+			break;
+		default:
+			error("unknown material", name);
+		}
+		if (!params.empty())
+			error("material has too many parameters", params);
+		break;
+	}
+	case hashKey("radius"): {
+		expectType(ObjectType::Sphere);
+		Sphere* sphere = static_cast<Sphere*>(object.get());
+		sphere->r = toFloat(value);
+		sphere->r2 = sphere->r * sphere->r;
+		break;
+	}
+	case hashKey("normal"):
+		expectType(ObjectType::Plane);
+		static_cast<Plane*>(object.get())->normal = toVec3(value);
+		break;
+	case hashKey("size"):
+		expectType(ObjectType::Mesh);
+		static_cast<Mesh*>(object.get())->size = toVec3(value);
+		break;
+	case hashKey("rot"):
+		expectType(ObjectType::Mesh);
+		static_cast<Mesh*>(object.get())->rot = toVec3(value);
+		break;
+	case hashKey("name"):
+		expectType(ObjectType::Mesh);
+		meshPath = std::string(value);
+		break;
+	case hashKey("pos_key"): {
+		// Object is added to scene when block is finished, so its index is the current count
+		Vec3f pos;
+		const int frame = toKeyframe(value, pos);
+		scene.animation.object(scene.objects.size()).pos.addKey(frame, pos);
+		break;
+	}
+	case hashKey("rot_key"): {
+		expectType(ObjectType::Mesh);
+		Vec3f rot;
+		const int frame = toKeyframe(value, rot);
+		scene.animation.object(scene.objects.size()).rot.addKey(frame, rot);
+		break;
+	}
+	case hashKey("diffuse_map"): {
+		expectType(ObjectType::Mesh);
+		if (!scene.options.useTextures)
+			break;
+		Mesh* mesh = static_cast<Mesh*>(object.get());
+		AssetCache* cache = scene.assets;
+		Stats* stats = &scene.stats;
+		pendingLoads.push_back(loaders.submit([mesh, cache, stats, budget = scene.options.memoryBudget, path = std::string(value)]() {
+			mesh->diffuseMap = loadTexture<TextureMap<Vec3f>>(cache, cache ? assetKey("diffuse", path) : std::string(), *stats, budget,
+				path, Mesh::loadDiffuseMap);
+			return mesh->diffuseMap != nullptr;
+		}));
+		break;
+	}
+	case hashKey("normal_map"): {
+		expectType(ObjectType::Mesh);
+		if (!scene.options.useTextures)
+			break;
+		Mesh* mesh = static_cast<Mesh*>(object.get());
+		AssetCache* cache = scene.assets;
+		Stats* stats = &scene.stats;
+		pendingLoads.push_back(loaders.submit([mesh, cache, stats, budget = scene.options.memoryBudget, path = std::string(value)]() {
+			mesh->normalMap = loadTexture<TextureMap<Vec3f>>(cache, cache ? assetKey("normal", path) : std::string(), *stats, budget,
+				path, Mesh::loadNormalMap);
+			return mesh->normalMap != nullptr;
+		}));
+		break;
+	}
+	case hashKey("specular_map"): {
+		expectType(ObjectType::Mesh);
+		if (!scene.options.useTextures)
+			break;
+		Mesh* mesh = static_cast<Mesh*>(object.get());
+		AssetCache* cache = scene.assets;
+		Stats* stats = &scene.stats;
+		pendingLoads.push_back(loaders.submit([mesh, cache, stats, budget = scene.options.memoryBudget, path = std::string(value)]() {
+			mesh->specularMap = loadTexture<TextureMap<float>>(cache, cache ? assetKey("specular", path) : std::string(), *stats, budget,
+				path, Mesh::loadSpecularMap);
+			return mesh->specularMap != nullptr;
+		}));
+		break;
+	}
+	default:
+		std::cout << "Scene, unknown object key: " << key << " at line " << lineNumber << '\n';
+	}
+}
+
+void SceneParser::parseAnimation(std::string_view key, std::string_view value)
+{
+	Animation& animation = scene.animation;
+	switch (hashKey(key)) {
+	case hashKey("frames"): {
+		size_t separator = value.find(',');
+		if (separator == std::string_view::npos)
+			error("expected first and last frame", value);
+		animation.firstFrame = toInt(value.substr(0, separator));
+		animation.lastFrame = toInt(value.substr(separator + 1));
+		if (animation.lastFrame < animation.firstFrame)
+			error("last frame is before first frame", value);
+		break;
+	}
+	case hashKey("position"): {
+		Vec3f pos;
+		const int frame = toKeyframe(value, pos);
+		animation.cameraPos.addKey(frame, pos);
+		break;
+	}
+	case hashKey("rotation"): {
+		Vec3f rot;
+		const int frame = toKeyframe(value, rot);
+		animation.cameraRot.addKey(frame, rot);
+		break;
+	}
+	default:
+		std::cout << "Scene, unknown animation key: " << key << " at line " << lineNumber << '\n';
+	}
+}
+
+bool SceneParser::toBool(std::string_view value) const
+{
+	bool result = false;
+	if (!parseBool(value, result))
+		error("expected 0 or 1", value);
+	return result;
+}
+
+int SceneParser::toInt(std::string_view value) const
+{
+	int result = 0;
+	if (!parseNumber(value, result))
+		error("expected integer", value);
+	return result;
+}
+
+float SceneParser::toFloat(std::string_view value) const
+{
+	float result = 0;
+	if (!parseNumber(value, result))
+		error("expected number", value);
+	return result;
+}
+
+Vec3f SceneParser::toVec3(std::string_view value) const
+{
+	Vec3f result;
+	if (!parseVec3(value, result))
+		error("expected 3 comma separated numbers", value);
+	return result;
+}
+
+int SceneParser::toKeyframe(std::string_view value, Vec3f& result) const
+{
+	size_t separator = value.find(',');
+	if (separator == std::string_view::npos)
+		error("expected frame followed by 3 comma separated numbers", value);
+	const int frame = toInt(value.substr(0, separator));
+	result = toVec3(value.substr(separator + 1));
+	return frame;
+}
+
+void SceneParser::error(const std::string& message, std::string_view at) const
+{
+	throw ParseError(message, lineNumber, (size_t)(at.data() - lineStart) + 1);
+}
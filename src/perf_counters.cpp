@@ -0,0 +1,125 @@
+// Hardware performance counters of the calling thread, read through Linux perf_event_open
+#include "perf_counters.h"
+
+#include <mutex>
+#include <cstring>
+
+#include "stats.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace
+{
+	const char* const eventNames[perfEventCount] = { "cycles", "instructions", "llc_misses", "branch_misses", "task_clock_ns" };
+
+	// First failure is kept, later threads fail for the same reason
+	std::mutex errorMutex;
+	std::string firstError;
+
+	void setError(const std::string& message)
+	{
+		std::lock_guard<std::mutex> lock(errorMutex);
+		if (firstError.empty())
+			firstError = message;
+	}
+
+#ifdef __linux__
+	const struct { uint32_t type; uint64_t config; } events[perfEventCount] = {
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+		{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+	};
+
+	// Events are opened one by one instead of as a group, so that missing ones
+	// do not take the rest with them
+	class ThreadCounters
+	{
+	public:
+		ThreadCounters()
+		{
+			for (int i = 0; i < perfEventCount; i++) {
+				perf_event_attr attr;
+				std::memset(&attr, 0, sizeof(attr));
+				attr.size = sizeof(attr);
+				attr.type = events[i].type;
+				attr.config = events[i].config;
+				attr.exclude_kernel = 1;
+				attr.exclude_hv = 1;
+				attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+				fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+				if (fds[i] < 0)
+					setError(std::strerror(errno));
+			}
+		}
+
+		~ThreadCounters()
+		{
+			for (int fd : fds)
+				if (fd >= 0)
+					close(fd);
+		}
+
+		unsigned read(PerfValues& values) const
+		{
+			unsigned mask = 0;
+			for (int i = 0; i < perfEventCount; i++) {
+				uint64_t data[3];	// value, time enabled, time running
+				if (fds[i] < 0 || ::read(fds[i], data, sizeof(data)) != (ssize_t)sizeof(data))
+					continue;
+				values.values[i] = data[2] && data[2] < data[1] ? (uint64_t)((double)data[0] * data[1] / data[2]) : data[0];
+				mask |= 1u << i;
+			}
+			return mask;
+		}
+
+	private:
+		int fds[perfEventCount];
+	};
+#endif
+}
+
+unsigned PerfCounters::read(PerfValues& values)
+{
+#ifdef __linux__
+	thread_local ThreadCounters counters;
+	return counters.read(values);
+#else
+	(void)values;
+	setError("performance counters are read only on Linux");
+	return 0;
+#endif
+}
+
+const char* PerfCounters::eventName(int event)
+{
+	return eventNames[event];
+}
+
+std::string PerfCounters::error()
+{
+	std::lock_guard<std::mutex> lock(errorMutex);
+	return firstError;
+}
+
+PerfScope::PerfScope(Stats& a_stats, PerfPhase a_phase, bool enabled)
+	: stats(enabled ? &a_stats : nullptr), phase(a_phase)
+{
+	if (stats)
+		events = PerfCounters::read(start);
+}
+
+PerfScope::~PerfScope()
+{
+	if (!stats)
+		return;
+	PerfValues end;
+	events &= PerfCounters::read(end);
+	stats->addPerf(phase, start, end, events);
+}
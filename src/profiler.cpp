@@ -0,0 +1,211 @@
+// Scoped zone profiler, compiled in only when RT_PROFILE is defined
+#include "profiler.h"
+
+#ifdef RT_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdlib>
+
+namespace profiler
+{
+	namespace
+	{
+		const size_t bufferSize = 1 << 16;	// zones kept per thread
+
+		struct Event
+		{
+			const char* name;
+			uint64_t start, duration;	// ns since profiler epoch
+		};
+
+		// Written only by its thread, read when trace is written
+		struct ThreadBuffer
+		{
+			size_t id = 0;
+			const char* name = nullptr;
+			std::vector<Event> events = std::vector<Event>(bufferSize);
+			std::atomic<size_t> written{ 0 };
+		};
+
+		struct Registry
+		{
+			std::mutex mutex;
+			std::vector<std::shared_ptr<ThreadBuffer>> threads;
+		};
+
+		const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+		uint64_t now()
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+		}
+
+		// Registry is never destroyed, pool threads may still record zones during exit
+		Registry& registry()
+		{
+			static Registry* instance = new Registry;
+			return *instance;
+		}
+
+		void report()
+		{
+			printSummary();
+			const char* env = std::getenv("RT_PROFILE_TRACE");
+			const std::string path = env && *env ? env : "profile.json";
+			if (writeTrace(path))
+				std::cout << "Profile trace written to " << path << '\n';
+			else
+				std::cout << "Could not write profile trace " << path << '\n';
+		}
+
+		ThreadBuffer& threadBuffer()
+		{
+			thread_local std::shared_ptr<ThreadBuffer> buffer = []() {
+				auto newBuffer = std::make_shared<ThreadBuffer>();
+				Registry& r = registry();
+				std::lock_guard<std::mutex> lock(r.mutex);
+				if (r.threads.empty())
+					std::atexit(report);
+				newBuffer->id = r.threads.size();
+				r.threads.push_back(newBuffer);
+				return newBuffer;
+			}();
+			return *buffer;
+		}
+
+		// Recorded zones of thread ordered by start, parents before their children
+		std::vector<Event> snapshot(const ThreadBuffer& buffer)
+		{
+			const size_t written = buffer.written.load(std::memory_order_acquire);
+			std::vector<Event> events;
+			for (size_t i = written - std::min(written, bufferSize); i < written; i++)
+				events.push_back(buffer.events[i % bufferSize]);
+			std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+				return a.start != b.start ? a.start < b.start : a.duration > b.duration;
+			});
+			return events;
+		}
+
+		std::string threadName(const ThreadBuffer& buffer)
+		{
+			return buffer.name ? buffer.name : "Thread " + std::to_string(buffer.id);
+		}
+
+		std::vector<std::shared_ptr<ThreadBuffer>> threads()
+		{
+			Registry& r = registry();
+			std::lock_guard<std::mutex> lock(r.mutex);
+			return r.threads;
+		}
+	}
+
+	Zone::Zone(const char* a_name) : name(a_name), start(now()) {}
+
+	Zone::~Zone()
+	{
+		ThreadBuffer& buffer = threadBuffer();
+		const size_t i = buffer.written.load(std::memory_order_relaxed);
+		buffer.events[i % bufferSize] = Event{ name, start, now() - start };
+		buffer.written.store(i + 1, std::memory_order_release);
+	}
+
+	void setThreadName(const char* name)
+	{
+		ThreadBuffer& buffer = threadBuffer();
+		std::lock_guard<std::mutex> lock(registry().mutex);
+		buffer.name = name;
+	}
+
+	bool writeTrace(const std::string& path)
+	{
+		std::ofstream file(path);
+		if (!file)
+			return false;
+		// Complete events with times in microseconds, one process and thread per buffer
+		file << std::fixed << std::setprecision(3);
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		bool first = true;
+		for (const auto& buffer : threads()) {
+			file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id
+				<< ",\"args\":{\"name\":\"" << threadName(*buffer) << "\"}}";
+			first = false;
+			for (const Event& event : snapshot(*buffer)) {
+				file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id
+					<< ",\"ts\":" << event.start / 1e3 << ",\"dur\":" << event.duration / 1e3 << '}';
+			}
+		}
+		file << "\n]}\n";
+		return (bool)file;
+	}
+
+	void printSummary()
+	{
+		// Zones are keyed by names of their enclosing zones, so that map order
+		// lists every zone right after its parent
+		struct Total
+		{
+			uint64_t time = 0;
+			size_t count = 0;
+		};
+		std::map<std::vector<std::string>, Total> totals;
+		std::cout << "Profile by thread, busy is time in outermost zones:\n";
+		for (const auto& buffer : threads()) {
+			const std::vector<Event> events = snapshot(*buffer);
+			if (events.empty())
+				continue;
+			struct Open
+			{
+				uint64_t end;
+				std::vector<std::string> path;
+			};
+			std::vector<Open> stack;
+			uint64_t busy = 0, end = 0;
+			for (const Event& event : events) {
+				const uint64_t eventEnd = event.start + event.duration;
+				while (!stack.empty() && eventEnd > stack.back().end)
+					stack.pop_back();
+				std::vector<std::string> path = stack.empty() ? std::vector<std::string>() : stack.back().path;
+				path.push_back(event.name);
+				Total& total = totals[path];
+				total.time += event.duration;
+				total.count++;
+				if (stack.empty())
+					busy += event.duration;
+				end = std::max(end, eventEnd);
+				stack.push_back({ eventEnd, std::move(path) });
+			}
+			const size_t written = buffer->written.load();
+			std::cout << "  " << std::left << std::setw(20) << threadName(*buffer) << std::right << std::fixed
+				<< std::setprecision(1) << " busy " << std::setw(10) << busy / 1e6 << " ms of " << std::setw(10)
+				<< (end - events.front().start) / 1e6 << " ms, " << events.size() << " zones";
+			if (written > bufferSize)
+				std::cout << ", " << written - bufferSize << " oldest dropped";
+			std::cout << '\n';
+		}
+
+		std::cout << "Profile by zone, summed over threads:\n";
+		for (const auto& [path, total] : totals) {
+			std::cout << "  " << std::string(2 * (path.size() - 1), ' ') << std::left
+				<< std::setw(std::max<int>(1, 32 - 2 * (int)(path.size() - 1))) << path.back() << std::right
+				<< std::fixed << std::setprecision(2) << std::setw(12) << total.time / 1e6 << " ms "
+				<< std::setw(8) << total.count << " calls";
+			if (path.size() > 1) {
+				const auto parent = totals.find(std::vector<std::string>(path.begin(), path.end() - 1));
+				if (parent != totals.end() && parent->second.time)
+					std::cout << std::setprecision(1) << std::setw(7) << 100.0 * total.time / parent->second.time << "% of parent";
+			}
+			std::cout << '\n';
+		}
+	}
+}
+
+#endif
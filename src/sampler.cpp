@@ -0,0 +1,236 @@
+// Low-discrepancy samplers, used by anti-aliasing and area lights
+#include "sampler.h"
+
+#include <cmath>
+#include <mutex>
+#include <algorithm>
+
+namespace
+{
+	const int blueNoiseSize = 64;	// blue noise tables are 64x64 and tiled over image
+
+	uint32_t hashUInt(uint32_t x)
+	{
+		x ^= x >> 16; x *= 0x7feb352du;
+		x ^= x >> 15; x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+	uint32_t hashSet(uint32_t x, uint32_t y, uint32_t sample, uint32_t dimension)
+	{
+		return hashUInt(x ^ hashUInt(y ^ hashUInt(sample ^ hashUInt(dimension))));
+	}
+
+	float toFloat(uint32_t v)
+	{
+		// 24 bits fit in float mantissa, result is always below 1
+		return (v >> 8) * (1.0f / 16777216.0f);
+	}
+
+	uint32_t reverseBits(uint32_t x)
+	{
+		x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+		x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+		x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+		x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+		return (x >> 16) | (x << 16);
+	}
+
+	// Hash-based nested uniform scramble (Laine-Karras permutation on reversed bits)
+	uint32_t owenScramble(uint32_t x, uint32_t seed)
+	{
+		x = reverseBits(x);
+		x += seed;
+		x ^= x * 0x6c50b47cu;
+		x ^= x * 0xb82f1e52u;
+		x ^= x * 0xc7afe638u;
+		x ^= x * 0x8d22f6e6u;
+		return reverseBits(x);
+	}
+
+	// Second Sobol dimension, first one is just reversed index
+	uint32_t sobolDim1(uint32_t index)
+	{
+		uint32_t result = 0;
+		for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+			if (index & 1)
+				result ^= v;
+		return result;
+	}
+}
+
+
+Sampler::Sampler(const SamplerType a_type)
+	: type(a_type)
+{
+	if (type == SamplerType::BlueNoise) {
+		blueNoiseTable(0);
+		blueNoiseTable(1);
+	}
+}
+
+Vec2f Sampler::get2D(uint32_t index, uint32_t x, uint32_t y, uint32_t sample, uint32_t dimension) const
+{
+	if (type == SamplerType::Sobol) {
+		return getSobol(index, hashSet(x, y, sample, dimension));
+	}
+	if (type == SamplerType::BlueNoise) {
+		// Each dimension looks at tables with a different toroidal offset
+		const uint32_t offset = hashUInt(sample ^ hashUInt(dimension));
+		const int tx = (x + (offset & 0xff)) % blueNoiseSize;
+		const int ty = (y + ((offset >> 8) & 0xff)) % blueNoiseSize;
+		return getR2(index, blueNoiseTable(0)[ty * blueNoiseSize + tx], blueNoiseTable(1)[ty * blueNoiseSize + tx]);
+	}
+	if (type == SamplerType::R2) {
+		const uint32_t hash = hashSet(x, y, sample, dimension);
+		return getR2(index, (hash & 0xffff) / 65536.0f, (hash >> 16) / 65536.0f);
+	}
+	return getR2(index, 0.5f, 0.5f);
+}
+
+Vec2f Sampler::getSobol(uint32_t index, uint32_t seed) const
+{
+	// Points are shuffled and every coordinate is scrambled with its own seed
+	index = owenScramble(index, seed);
+	return Vec2f{ toFloat(owenScramble(reverseBits(index), hashUInt(seed ^ 0xa511e9b3u))),
+		toFloat(owenScramble(sobolDim1(index), hashUInt(seed ^ 0x63d83595u))) };
+}
+
+Vec2f Sampler::getR2(uint32_t index, float shiftX, float shiftY) const
+{
+	// Generalized golden ratio sequence
+	const double a1 = 0.7548776662466927, a2 = 0.5698402909980532;
+	const float u = (float)(shiftX + a1 * index);
+	const float v = (float)(shiftY + a2 * index);
+	return Vec2f{ std::min(u - std::floor(u), 0.99999994f), std::min(v - std::floor(v), 0.99999994f) };
+}
+
+const std::vector<float>& Sampler::blueNoiseTable(int channel)
+{
+	static std::vector<float> tables[2];
+	static std::once_flag built;
+	std::call_once(built, []() {
+		tables[0] = buildBlueNoise(0x2545f491u);
+		tables[1] = buildBlueNoise(0x9e3779b9u);
+	});
+	return tables[channel];
+}
+
+std::vector<float> Sampler::buildBlueNoise(uint32_t seed)
+{
+	// Void-and-cluster: pixels are ranked by inserting points in largest voids
+	// and removing them from tightest clusters, energy is a toroidal gaussian
+	const int n = blueNoiseSize;
+	const int count = n * n;
+	const float sigma = 1.5f;
+	std::vector<float> kernel(count);
+	for (int dy = 0; dy < n; dy++) {
+		for (int dx = 0; dx < n; dx++) {
+			const float wx = (float)std::min(dx, n - dx), wy = (float)std::min(dy, n - dy);
+			kernel[dy * n + dx] = expf(-(wx * wx + wy * wy) / (2 * sigma * sigma));
+		}
+	}
+
+	std::vector<char> points(count, 0);
+	std::vector<float> energy(count, 0.0f);
+	auto update = [&](int p, float sign) {
+		const int px = p % n, py = p / n;
+		for (int y = 0; y < n; y++) {
+			const float* row = &kernel[((y - py + n) % n) * n];
+			for (int x = 0; x < n; x++)
+				energy[y * n + x] += sign * row[(x - px + n) % n];
+		}
+	};
+	auto tightestCluster = [&]() {
+		int best = -1;
+		for (int i = 0; i < count; i++)
+			if (points[i] && (best < 0 || energy[i] > energy[best]))
+				best = i;
+		return best;
+	};
+	auto largestVoid = [&]() {
+		int best = -1;
+		for (int i = 0; i < count; i++)
+			if (!points[i] && (best < 0 || energy[i] < energy[best]))
+				best = i;
+		return best;
+	};
+
+	// Random initial pattern with tenth of pixels set
+	const int initialCount = count / 10;
+	uint32_t state = seed;
+	for (int placed = 0; placed < initialCount;) {
+		state = hashUInt(state + 0x9e3779b9u);
+		int p = state % count;
+		if (points[p])
+			continue;
+		points[p] = 1;
+		update(p, 1);
+		placed++;
+	}
+
+	// Move points from clusters to voids until pattern is stable
+	for (int iteration = 0; iteration < count; iteration++) {
+		int cluster = tightestCluster();
+		points[cluster] = 0;
+		update(cluster, -1);
+		int gap = largestVoid();
+		points[gap] = 1;
+		update(gap, 1);
+		if (gap == cluster)
+			break;
+	}
+	std::vector<char> initialPoints = points;
+	std::vector<float> initialEnergy = energy;
+
+	// Rank initial points by removing tightest clusters first
+	std::vector<int> rank(count, 0);
+	for (int r = initialCount - 1; r >= 0; r--) {
+		int cluster = tightestCluster();
+		points[cluster] = 0;
+		update(cluster, -1);
+		rank[cluster] = r;
+	}
+
+	// Rank the rest of pixels by filling largest voids
+	points = initialPoints;
+	energy = initialEnergy;
+	for (int r = initialCount; r < count; r++) {
+		int gap = largestVoid();
+		points[gap] = 1;
+		update(gap, 1);
+		rank[gap] = r;
+	}
+
+	std::vector<float> table(count);
+	for (int i = 0; i < count; i++)
+		table[i] = (rank[i] + 0.5f) / count;
+	return table;
+}
+
+
+PixelSampler::PixelSampler(const Sampler& a_sampler, uint32_t a_x, uint32_t a_y)
+	: sampler(a_sampler), x(a_x), y(a_y) {}
+
+Vec2f PixelSampler::pixelOffset(uint32_t n) const
+{
+	// Pixel offsets form their own set, separate from dimensions of pixel samples
+	return sampler.get2D(n, x, y, 0xffffffffu, 0);
+}
+
+void PixelSampler::startSample(uint32_t n)
+{
+	sample = n;
+	dimension = 0;
+}
+
+uint32_t PixelSampler::nextDimension()
+{
+	return dimension++;
+}
+
+Vec2f PixelSampler::get2D(uint32_t index, uint32_t a_dimension) const
+{
+	return sampler.get2D(index, x, y, sample, a_dimension);
+}
@@ -1,825 +1,1062 @@
-// classed describing scene and camera
-#include "scene.h"
-
-#include <algorithm>
-#include <thread>
-#include <map>
-#include <fstream>
-#include <cstring>
-
-#include "timer.h"
-#include "util.h"
-#include "options.h"
-#include "stats.h"
-
-Camera::Camera(const Vec3f& a_pos, const Vec3f& a_rot)
-	: pos(a_pos), rot(a_rot) {}
-
-Ray Camera::getRay(const float xPix, const  float yPix)
-{
-	// Build rotation matrix
-	if (!cameraRotated) {
-		cameraRotated = true;
-		const float& x = degToRad(rot.x);
-		Matrix44f mx(
-			1, 0, 0, 0,
-			0, cosf(x), -sinf(x), 0,
-			0, sinf(x), cosf(x), 0,
-			0, 0, 0, 1
-		);
-
-		const float& y = degToRad(rot.y);
-		Matrix44f my(
-			cosf(y), 0, sinf(y), 0,
-			0, 1, 0, 0,
-			-sinf(y), 0, cosf(y), 0,
-			0, 0, 0, 1
-		);
-
-		const float& z = degToRad(rot.z);
-		Matrix44f mz(
-			cosf(z), -sinf(z), 0, 0,
-			sinf(z), cosf(z), 0, 0,
-			0, 0, 1, 0,
-			0, 0, 0, 1
-		);
-
-		rMatrix = mz * my * mx;
-	}
-
-	// Rotate camera direction
-	Vec3f dir = rMatrix.multVecMatrix(Vec3f(xPix, yPix, -1).normalize());
-	return Ray{ this->pos , dir };
-}
-
-
-Scene::Scene(const std::string& sceneName)
-{
-	sceneLoadSuccess = this->loadScene(sceneName);
-}
-
-bool Scene::loadScene(const std::string& scenePath)
-{
-	if (options::enableOutput) {
-		std::cout << "Loading scene " << scenePath << '\n';
-	}
-
-    enum class BlockType { None, Options, Light, Object };
-    std::map<std::string, BlockType> blockMap;
-    blockMap["[options]"] = BlockType::Options;
-    blockMap["[light]"] = BlockType::Light;
-    blockMap["[object]"] = BlockType::Object;
-    blockMap["[end]"] = BlockType::None;
-    BlockType blockType = BlockType::None;
-
-    std::string str;
-    std::ifstream ifs(scenePath, std::ifstream::in);
-
-	if (!ifs.good()) {
-		std::cout << "Could not open scene file: " << scenePath << '\n';
-		LOG_ERROR();
-	}
-    Light* light = nullptr;
-    Object* object = nullptr;
-
-    while (ifs.good()) {
-        std::getline(ifs, str);
-        if (str.length() == 0)
-            continue;
-
-        // Finish previous block
-        if (strContains(str, "[")) {
-            if (blockType == BlockType::Light) {
-				if (light == nullptr)
-					LOG_ERROR();
-                lights.push_back(std::unique_ptr<Light>(light));
-            }
-            else if (blockType == BlockType::Object) {
-				if (object == nullptr)
-					LOG_ERROR();
-                objects.push_back(std::unique_ptr<Object>(object));
-            }
-        }
-
-        // Skip commented block
-        if (strContains(str, "#[")) {
-            do {
-                std::getline(ifs, str);
-            } while (!strContains(str, "[") || strContains(str, "#["));
-            if (!ifs.good())
-                break;
-        }
-
-        // Skip comments
-        if (strContains(str, "#"))
-            str.erase(str.find('#'));
-        if (str.length() == 0)
-            continue;
-
-        // Select block
-        if (str[0] == '[') {
-			if (blockMap.find(str) == blockMap.end()) 
-				LOG_ERROR();
-            blockType = blockMap[str];
-            if (blockType == BlockType::None)
-                break;
-            continue;
-        }
-
-        // Parse the line
-        if (blockType == BlockType::Options) {
-			if (!strContains(str, "=")) 
-				LOG_ERROR();
-			std::string key_s(str.c_str(), str.find('='));
-			key_s.erase(std::remove(key_s.begin(), key_s.end(), ' '), key_s.end());
-			key_s.erase(std::remove(key_s.begin(), key_s.end(), '\t'), key_s.end());
-			
-            std::string_view key(key_s);
-            std::string_view value(str.c_str() + str.find('=') + 1);
-
-
-			if (strEquals(key, "outputProgress"))
-				options::outputProgress = strToBool(value);
-			else if (strEquals(key, "useBackfaceCulling"))
-				options::useBackfaceCulling = strToBool(value);
-			else if (strEquals(key, "collectStatistics"))
-				options::collectStatistics = strToBool(value);
-			else if (strEquals(key, "enableOutput"))
-				options::enableOutput = strToBool(value);
-			else if (strEquals(key, "imageOutput"))
-				options::imageOutput = strToBool(value);
-			else if (strEquals(key, "useAC"))
-				options::useAC = strToBool(value);
-			else if (strEquals(key, "showAC"))
-				options::showAC = strToBool(value);
-			else if (strEquals(key, "useSkybox"))
-				options::useSkybox = strToBool(value);
-			else if (strEquals(key, "useTextures"))
-				options::useTextures = strToBool(value);
-			else if (strEquals(key, "showNormals"))
-				options::showNormals = strToBool(value);
-			else if (strEquals(key, "width"))
-                options.width = strToInt(value);
-            else if (strEquals(key, "height"))
-                options.height = strToInt(value);
-            else if (strEquals(key, "fov"))
-                camera.fov = strToFloat(value);
-            else if (strEquals(key, "image_name"))
-                options.imageName = std::string(value);
-            else if (strEquals(key, "n_workers"))
-                options.nWorkers = strToInt(value);
-            else if (strEquals(key, "max_ray_depth"))
-                options.maxRayDepth = strToInt(value);
-            else if (strEquals(key, "ac_penalty"))
-                options.acPenalty = strToInt(value);
-            else if (strEquals(key, "background_color"))
-                options.backgroundColor = str3ToFloat(splitString(value, ','));
-            else if (strEquals(key, "position"))
-                camera.pos = str3ToFloat(splitString(value, ','));
-            else if (strEquals(key, "rotation"))
-                camera.rot = str3ToFloat(splitString(value, ','));
-			else if (strEquals(key, "skyboxes")) {
-				auto res = splitString(value, ',');
-				if (res.size() < 6) 
-					LOG_ERROR();
-				for (int i = 0; i < 6; i++) {
-					strncpy(options.names[i], res[i].c_str(), 64);
-				}
-				options::useSkybox = 1;
-			}
-			else {
-				std::cout << "Scene, unknown key: " << key << '\n';
-			}
-        }
-        else if (blockType == BlockType::Light) {
-			if (!strContains(str, "=")) 
-				LOG_ERROR();
-            std::string_view key(str.c_str(), str.find('='));
-            std::string_view value(str.c_str() + str.find('=') + 1);
-
-            if (strEquals(key, "type")) {
-                if (strEquals(value, "distant"))
-                    light = new DistantLight();
-                else if (strEquals(value, "point"))
-                    light = new PointLight();
-				else if (strEquals(value, "area"))
-					light = new AreaLight();
-            }
-            else if (light == nullptr)
-                std::cout << "Error, light type missing\n";
-            else if (strEquals(key, "color"))
-                light->color = str3ToFloat(splitString(value, ','));
-            else if (strEquals(key, "intensity"))
-                light->intensity = strToFloat(value);
-            if (strEquals(key, "direction")) {
-				if (light->type != LightType::DistantLight) 
-					LOG_ERROR();
-                static_cast<DistantLight*>(light)->dir = str3ToFloat(splitString(value, ','));
-            }
-            else if (strEquals(key, "position")) {
-				if (light->type != LightType::PointLight) 
-					LOG_ERROR();
-                static_cast<PointLight*>(light)->pos = str3ToFloat(splitString(value, ','));
-            }
-			else if (strEquals(key, "pos")) {
-				if (light->type != LightType::AreaLight) 
-					LOG_ERROR();
-				static_cast<AreaLight*>(light)->pos = str3ToFloat(splitString(value, ','));
-			}
-			else if (strEquals(key, "i")) {
-				if (light->type != LightType::AreaLight) 
-					LOG_ERROR();
-				static_cast<AreaLight*>(light)->i = str3ToFloat(splitString(value, ','));
-			}
-			else if (strEquals(key, "j")) {
-				if (light->type != LightType::AreaLight) 
-					LOG_ERROR();
-				static_cast<AreaLight*>(light)->j = str3ToFloat(splitString(value, ','));
-			}
-			else if (strEquals(key, "samples")) {
-				if (light->type != LightType::AreaLight) 
-					LOG_ERROR();
-				static_cast<AreaLight*>(light)->samples = strToInt(value);
-			}
-        }
-        else if (blockType == BlockType::Object) {
-           if (!strContains(str, "=")) 
-			   LOG_ERROR();
-            std::string_view key(str.c_str(), str.find('='));
-            std::string_view value(str.c_str() + str.find('=') + 1);
-
-            if (strEquals(key, "type")) {
-                if (strEquals(value, "plane"))
-                    object = new Plane();
-                else if (strEquals(value, "sphere"))
-                    object = new Sphere();
-                else if (strEquals(value, "mesh"))
-                    object = new Mesh();
-            }
-            else if (object == nullptr) {
-                std::cout << "Error, object type missing\n";
-            }
-            else if (strEquals(key, "color")) {
-                object->color = str3ToFloat(splitString(value, ','));
-            }
-            else if (strEquals(key, "pos")) {
-                object->pos = str3ToFloat(splitString(value, ','));
-            }
-            else if (strEquals(key, "material")) {
-                auto res = splitString(value, ',');
-                if (strEquals(res[0], "transparent")) {
-                    object->materialType = MaterialType::Transparent;
-					object->indexOfRefraction = strToFloat(res[1]);
-                }
-                else if (strEquals(res[0], "reflective")) {
-                    object->materialType = MaterialType::Reflective;
-                }
-                if (strEquals(res[0], "phong")) {
-                    object->materialType = MaterialType::Phong;
-                    object->ambient = strToFloat(res[1]);
-                    object->diffuse = strToFloat(res[2]);
-                    object->specular = strToFloat(res[3]);
-                    object->nSpecular = strToFloat(res[4]);
-                }
-            }
-            else if (object->objectType == ObjectType::Sphere) {
-                Sphere* sphere = static_cast<Sphere*>(object);
-                if (strEquals(key, "radius")) {
-                    sphere->r = strToFloat(value);
-                    sphere->r2 = powf(sphere->r, 2);
-                }
-            }
-            else if (object->objectType == ObjectType::Plane) {
-                Plane* plane = static_cast<Plane*>(object);
-                if (strEquals(key, "normal")) {
-                    plane->normal = str3ToFloat(splitString(value, ','));
-                }
-            }
-            else if (object->objectType == ObjectType::Mesh) {
-                Mesh* mesh = static_cast<Mesh*>(object);
-                if (strEquals(key, "size")) {
-                    mesh->size = str3ToFloat(splitString(value, ','));
-                }
-                else if (strEquals(key, "rot")) {
-                    mesh->rot = str3ToFloat(splitString(value, ','));
-                }
-                else if (strEquals(key, "name")) {
-                    mesh->loadOBJ(std::string(value), options);
-                }
-				else if (strEquals(key, "diffuse_map")) {
-					mesh->diffuseMapLoaded = mesh->loadDiffuseMap(std::string(value));
-				}
-				else if (strEquals(key, "normal_map")) {
-					mesh->normalMapLoaded = mesh->loadNormalMap(std::string(value));
-				}
-				else if (strEquals(key, "specular_map")) {
-					mesh->specularMapLoaded = mesh->loadSpecularMap(std::string(value));
-				}
-            }
-        }
-    }
-
-    ifs.close();
-
-	if (options::useSkybox) {
-		loadSkybox();
-	}
-	
-	return true;
-}
-
-void Scene::loadSkybox()
-{
-	// Load skybox and transform it to Vec3f
-	if (options::useSkybox) {
-		unsigned char* u_skyboxes[6];
-		int width, height;
-		for (int i = 0; i < 6; i++) {
-			u_skyboxes[i] = loadBMP(options.names[i], width, height);
-		}
-		skyboxHeight = height;
-		skyboxWidth = width;
-
-		for (int k = 0; k < 6; k++) {
-			skyboxes[k] = new Vec3f[width * (size_t)height];
-			for (int i = 0; i < height; i++) {
-				for (int j = 0; j < width; j++) {
-					int v = 3 * (i * width + j);
-					float x = u_skyboxes[k][v], y = u_skyboxes[k][v + 1], z = u_skyboxes[k][v + 2];
-					x /= 256; y /= 256; z /= 256;
-					skyboxes[k][i * width + j] = Vec3f{ x, y, z };
-				}
-			}
-		}
-	}
-}
-
-Vec3f Scene::getSkybox(const Vec3f& dir) const
-{
-	if (!options::useSkybox) {
-		return options.backgroundColor;
-	}
-
-	auto toPixel = [](const float& v, const int& max)
-	{
-		int val = (int)((v + 1.0f) / 2.0f * max);
-		if (val >= max) val = max - 1;
-		return val;
-	};
-
-	
-	// Get color from one of six skyboxes
-	Vec3f adir = dir;
-	float max = std::max(fabs(adir.x), std::max(fabs(adir.y), fabs(adir.z)));
-	if (max == fabs(adir.z)) {
-		if (adir.z < 0) {
-			adir = dir * (1 / -dir.z);
-			int i = toPixel(adir.y, skyboxHeight);
-			int j = toPixel(adir.x, skyboxWidth);
-			return skyboxes[1][i * skyboxWidth + j];
-		}
-		else {
-			adir = dir * (1 / dir.z);
-			int i = toPixel(adir.y, skyboxHeight);
-			int j = toPixel(-adir.x, skyboxWidth);
-			return skyboxes[3][i * skyboxWidth + j];
-		}
-	}
-	else if (max == fabs(adir.x)) {
-		if (adir.x < 0) {
-			adir = dir * (1 / -dir.x);
-			int i = toPixel(adir.y, skyboxHeight);
-			int j = toPixel(-adir.z, skyboxWidth);
-			return skyboxes[0][i * skyboxWidth + j];
-		}
-		else {
-			adir = dir * (1 / dir.x);
-			int i = toPixel(adir.y, skyboxHeight);
-			int j = toPixel(adir.z, skyboxWidth);
-			return skyboxes[2][i * skyboxWidth + j];
-		}
-	}
-	else {
-		if (adir.y < 0) {
-			adir = dir * (1 / -dir.y);
-			int i = toPixel(adir.z, skyboxHeight);
-			int j = toPixel(adir.x, skyboxWidth);
-			return skyboxes[5][i * skyboxWidth + j];
-		}
-		else {
-			adir = dir * (1 / dir.y);
-			int i = toPixel(adir.z, skyboxHeight);
-			int j = toPixel(adir.x, skyboxWidth);
-			return skyboxes[4][i * skyboxWidth + j];
-		}
-	}
-
-	return options.backgroundColor;
-}
-
-void Scene::renderWorker(Vec3f* frameBuffer, size_t y0, size_t y1)
-{
-	// Render pixels in rows from y0 to y1
-	const float scale = tanf(camera.fov * 0.5f / 180.0f * (float)(M_PI));
-	const float imageAspectRatio = (options.width) / (float)options.height;
-	for (size_t y = y0; y < y1; y++) {
-		for (size_t x = 0; x < options.width; x++) {
-			/*if (x == 165 && y == 115) {
-				frameBuffer[x + y * options.width] = { 1,0,0 };
-				continue;
-			}*/
-			float xPix = (2 * (x + 0.5f) / (float)options.width - 1) * scale * imageAspectRatio;
-			float yPix = -(2 * (y + 0.5f) / (float)options.height - 1) * scale;
-			Ray ray = this->camera.getRay(xPix, yPix);
-			frameBuffer[x + y * options.width] = Render::castRay(ray, *this, 0);
-			finishedPixels.store(finishedPixels.load() + 1);
-		}
-	}
-	finishedWorkers.store(finishedWorkers.load() + 1);
-}
-
-int Scene::launchWorkers(Vec3f* frameBuffer)
-{
-	Timer t("Render scene");
-
-	// Create threads with equal load
-	std::vector<std::unique_ptr<std::thread>> threadPool;
-	for (size_t i = 0; i < options.nWorkers; i++) {
-		size_t y0 = options.height / options.nWorkers * i;
-		size_t y1 = options.height / options.nWorkers * (i + 1);
-		if (i + 1 == options.nWorkers) y1 = options.height;
-		threadPool.push_back(std::make_unique<std::thread>(&Scene::renderWorker, this, frameBuffer, y0, y1));
-	}
-
-	if (options::outputProgress) {
-		// Until all workers finish we will print progress
-		while (finishedWorkers.load() != options.nWorkers) {
-			auto start = std::chrono::high_resolution_clock::now();
-			for (int i = 0; i < 100; i++) {
-				if (finishedWorkers.load() == options.nWorkers)
-					break;
-				if (std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count() >= 1000ll)
-					break;
-				std::this_thread::sleep_for(std::chrono::milliseconds(10));
-			}
-			if (std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count() >= 1000ll) {
-				const float progressCoef = 100.0f / (options.width * options.height);
-				std::cout << std::fixed << std::setw(2) << std::setprecision(0) << progressCoef * finishedPixels.load() << "%\n";
-			}
-		}
-	}
-
-	for (auto& thread : threadPool)
-		thread->join();
-
-	return 0;
-}
-
-long long Scene::render()
-{
-	if (!sceneLoadSuccess) return -1;
-	Timer t("Total time");
-	Vec3f* frameBuffer = new Vec3f[options.height * options.width];
-	// To show AC we need to another routine
-	if (options::showAC) {
-		const Vec3f orig = { 0, 0, 0 };
-		const float scale = tanf(camera.fov * 0.5f / 180.0f * (float)(M_PI));
-		float imageAspectRatio = (options.width) / (float)options.height;
-
-		int acMax = 0;
-		int* acBuffer = new int[options.width * options.height];
-
-		for (size_t y = 0; y < options.height; y++) {
-			for (size_t x = 0; x < options.width; x++) {
-				float xPix = (2 * (x + 0.5f) / (float)options.width - 1) * scale * imageAspectRatio;
-				float yPix = -(2 * (y + 0.5f) / (float)options.height - 1) * scale;
-				Ray ray = this->camera.getRay(xPix, yPix);
-				int val = countAC(ray);
-				if (val > acMax) acMax = val;
-				acBuffer[x + y * options.width] = val;
-			}
-		}
-
-		for (size_t y = 0; y < options.height; y++) {
-			for (size_t x = 0; x < options.width; x++) {
-				float val = (float)acBuffer[x + y * options.width];
-				val /= acMax;
-				frameBuffer[x + y * options.width] = Vec3f{ val };
-			}
-		}
-		delete[] acBuffer;
-	}
-	else {
-		launchWorkers(frameBuffer);
-	}
-
-	if (options::imageOutput) {
-		saveImage(frameBuffer, options);
-	}
-
-	delete[] frameBuffer;
-
-	if (options::useSkybox) {
-		for (int k = 0; k < 6; k++)
-			if (skyboxes[k])
-				delete[] skyboxes[k];
-	}
-
-	if (options::collectStatistics) {
-		stats::printStats();
-	}
-
-	if (options::enableOutput) {
-		std::cout << '\n';
-	}
-	return t.stop();
-}
-
-int Scene::countAC(const Ray& ray)
-{
-	int sum = 0;
-	for (auto& obj : objects) {
-		if (obj->objectType == ObjectType::Mesh) {
-			Mesh* mesh = dynamic_cast<Mesh*>(obj.get());
-			sum += mesh->ac.get()->recCountAC(ray);
-		}
-	}
-	return sum;
-}
-
-
-Vec3f Render::reflect(const Vec3f& dir, const Vec3f& normal)
-{
-	return dir - 2 * dir.dotProduct(normal) * normal;
-}
-
-Vec3f Render::refract(const Vec3f& dir, const Vec3f& normal, const float& indexOfRefraction)
-{
-	float n1 = 1, n2 = indexOfRefraction;   // n1 - air, n2 - object
-	float cosi = clamp(-1, 1, dir.dotProduct(normal));
-	Vec3f modNormal = normal;
-	if (cosi < 0) {
-		// outside the medium
-		cosi = -cosi;
-	}
-	else {
-		// inside the medium
-		std::swap(n1, n2);
-		modNormal = -normal;
-	}
-	float rri = n1 / n2; // relative refraction index
-	float k = 1 - rri * rri * (1 - cosi * cosi); // critical angle test
-	if (k < 0)
-		return 0;
-	return rri * dir + (rri * cosi - sqrtf(k)) * modNormal;
-}
-
-float Render::fresnel(const Vec3f& dir, const Vec3f& normal, const float& indexOfRefraction)
-{
-	float n1 = 1, n2 = indexOfRefraction;   // n1 - air, n2 - object
-	float cosi = clamp(-1, 1, dir.dotProduct(normal));
-	if (cosi > 0) {
-		// outside the medium
-		std::swap(n1, n2);
-	}
-	float sint = n1 / n2 * sqrtf(std::max(0.f, 1 - cosi * cosi));  // Snell's law
-
-	float kr;
-	if (sint >= 1) {
-		// total internal reflection
-		kr = 1;
-	}
-	else {
-		// Fresnel equation
-		float cost = sqrtf(std::max(0.f, 1 - sint * sint));
-		cosi = fabsf(cosi);
-		float rs = ((n2 * cosi) - (n1 * cost)) / ((n2 * cosi) + (n1 * cost));
-		float rp = ((n1 * cosi) - (n2 * cost)) / ((n1 * cosi) + (n2 * cost));
-		kr = (rs * rs + rp * rp) / 2;
-	}
-	return kr;
-}
-
-bool Render::trace(const Ray& ray, const ObjectVector& objects, IntersectInfo& intrInfo)
-{
-	// Try to intersect all objects, choose the closest one
-	if (options::collectStatistics) {
-		stats::raysCasted.store(stats::raysCasted.load() + 1);
-	}
-	intrInfo.hitObject = nullptr;
-	for (auto i = objects.begin(); i != objects.end(); i++) {
-		// transparent objects do not cast shadows
-		if (ray.rayType == RayType::ShadowRay && (*i).get()->materialType == MaterialType::Transparent)
-			continue;
-		float tNear = std::numeric_limits<float>::max();
-		const Triangle* ptr = nullptr;
-		Vec2f uv;
-
-		if ((*i).get()->objectType == ObjectType::Mesh) {
-			if (dynamic_cast<Mesh*>((*i).get())->intersectMesh(ray, tNear, ptr, uv) && tNear < intrInfo.tNear) {
-				intrInfo.hitObject = (*i).get();
-				intrInfo.tNear = tNear;
-				intrInfo.triPtr = ptr;
-				intrInfo.uv = uv;
-			}
-		}
-		else {
-			if ((*i).get()->intersectObject(ray, tNear, uv) && tNear < intrInfo.tNear) {
-				intrInfo.hitObject = (*i).get();
-				intrInfo.tNear = tNear;
-				intrInfo.uv = uv;
-			}
-		}
-	}
-	return (intrInfo.hitObject != nullptr);
-}
-
-Vec3f Render::castRay(const Ray& ray, const Scene& scene, const int depth)
-{
-	if (depth > scene.options.maxRayDepth) return scene.getSkybox(ray.dir);
-	IntersectInfo intrInfo;
-	if (trace(ray, scene.objects, intrInfo)) {
-		Vec3f objectColor = intrInfo.hitObject->color;
-
-		Vec2f hitTexCoordinates;
-		Vec3f hitNormal, hitColor = { 0 };
-		// Get point coordinate and normal
-		Vec3f hitPoint = ray.orig + ray.dir * intrInfo.tNear;
-		intrInfo.hitObject->getSurfaceData(hitPoint, intrInfo.triPtr, intrInfo.uv, hitNormal, hitTexCoordinates);
-
-		if (options::showNormals)
-			return hitNormal / 2.0f + Vec3f{ 0.5f };
-
-		if (intrInfo.hitObject->objectType == ObjectType::Mesh)
-			objectColor = static_cast<const Mesh*>(intrInfo.hitObject)->getDiffuseColor(hitTexCoordinates);
-
-		Vec3f diffuseComponent = 0, specularComponent = 0;
-		IntersectInfo intrShadInfo;
-		Vec3f lightDir, lightIntensity;
-		if (intrInfo.hitObject->materialType == MaterialType::Diffuse) {
-			// For diffuse objects collect light from all visible sources
-			for (size_t i = 0; i < scene.lights.size(); ++i) {
-				if (scene.lights[i]->type != LightType::AreaLight) {
-					// Get light direction, intensity and distance
-					scene.lights[i]->illuminate(hitPoint, lightDir, lightIntensity, intrShadInfo.tNear);
-					// Check that light source is visible
-					bool vis = !trace(Ray{ hitPoint + hitNormal * scene.options.bias, -lightDir, RayType::ShadowRay }, scene.objects, intrShadInfo);
-					diffuseComponent += lightIntensity * (vis * std::max(0.f, hitNormal.dotProduct(-lightDir)));
-				}
-				else {
-					// Area light requires different routine
-					AreaLight* light = dynamic_cast<AreaLight*>(scene.lights[i].get());
-
-					light->setPoints();
-					float diffuseSum = 0;
-					lightIntensity = light->color * std::min(1.0f, (float)(light->intensity / (4 * M_PI * (hitPoint - light->pos).length2() / 1000)));
-
-					// Add all light samples
-					for (const auto& p : light->points) {
-						lightDir = hitPoint - p;
-						intrShadInfo.tNear = lightDir.length();
-						bool vis = !Render::trace(Ray{ hitPoint + hitNormal * scene.options.bias, -lightDir.normalize(), RayType::ShadowRay }, scene.objects, intrShadInfo);
-						diffuseSum += vis * std::max(0.f, hitNormal.dotProduct(-lightDir));
-					}
-					diffuseComponent += diffuseSum / light->points.size() * lightIntensity;
-				}
-			}
-			hitColor = objectColor * diffuseComponent;
-		}
-		else if (intrInfo.hitObject->materialType == MaterialType::Phong) {
-			// For Phong object we will combine colors of object color, diffuse and specular
-			for (uint32_t i = 0; i < scene.lights.size(); ++i) {
-				if (scene.lights[i]->type != LightType::AreaLight) {
-					// Get light direction, intensity and distance
-					scene.lights[i]->illuminate(hitPoint, lightDir, lightIntensity, intrShadInfo.tNear);
-					// Check that light source is visible
-					bool vis = !trace(Ray{ hitPoint + hitNormal * scene.options.bias, -lightDir, RayType::ShadowRay }, scene.objects, intrShadInfo);
-
-					// Compute the diffuse component
-					diffuseComponent += vis * lightIntensity * std::max(0.f, hitNormal.dotProduct(-lightDir));
-
-					// Compute the specular component
-					Vec3f reflectedRay = reflect(lightDir, hitNormal);
-					specularComponent += vis * lightIntensity * std::pow(std::max(0.f, reflectedRay.dotProduct(-ray.dir)), intrInfo.hitObject->nSpecular);
-				}
-				else {
-					// Area light requires different routine
-					AreaLight* light = dynamic_cast<AreaLight*>(scene.lights[i].get());
-
-					light->setPoints();
-					float areaIntensity = 0;
-					lightIntensity = light->color * std::min(1.0f, (float)(light->intensity / (4 * M_PI * (hitPoint - light->pos).length2() / 1000)));
-					
-					float specularSum = 0;
-					float diffuseSum = 0;
-					// Add all light samples
-					for (const auto& p : light->points) {
-						lightDir = hitPoint - p;
-						intrShadInfo.tNear = lightDir.length();
-						bool vis = !trace(Ray{ hitPoint + hitNormal * scene.options.bias, -lightDir.normalize(), RayType::ShadowRay }, scene.objects, intrShadInfo);
-						diffuseSum += vis * std::max(0.f, hitNormal.dotProduct(-lightDir));
-						Vec3f reflectedRay = reflect(lightDir, hitNormal);
-						specularSum += vis * std::max(0.f, reflectedRay.dotProduct(-ray.dir));
-					}
-					diffuseComponent += diffuseSum / light->points.size() * lightIntensity;
-					specularComponent += std::pow(specularSum / light->points.size(), intrInfo.hitObject->nSpecular) * lightIntensity;
-				}
-			}
-			float specularCoefficient = intrInfo.hitObject->specular;
-			if (intrInfo.hitObject->objectType == ObjectType::Mesh)
-				specularCoefficient = static_cast<const Mesh*>(intrInfo.hitObject)->getSpecularValue(hitTexCoordinates);
-			hitColor = objectColor * intrInfo.hitObject->ambient + diffuseComponent * intrInfo.hitObject->diffuse + specularComponent * specularCoefficient;
-		}
-		else if (intrInfo.hitObject->materialType == MaterialType::Reflective) {
-			// Get info from reflected ray
-			Ray reflectedRay{ hitPoint + scene.options.bias * hitNormal, ray.dir - 2 * ray.dir.dotProduct(hitNormal) * hitNormal };
-
-			hitColor = 0.8f * castRay(reflectedRay, scene, depth + 1);
-
-			// Add light reflections
-			specularComponent = 0;
-			for (uint32_t i = 0; i < scene.lights.size(); ++i) {
-				if (scene.lights[i]->type != LightType::AreaLight) {
-					scene.lights[i]->illuminate(hitPoint, lightDir, lightIntensity, intrShadInfo.tNear);
-					bool vis = !trace(Ray{ hitPoint + hitNormal * scene.options.bias, -lightDir, RayType::ShadowRay }, scene.objects, intrShadInfo);
-					Vec3f reflectedRay = reflect(lightDir, hitNormal);
-					specularComponent += vis * lightIntensity * std::pow(std::max(0.f, reflectedRay.dotProduct(-ray.dir)), intrInfo.hitObject->nSpecular);
-				}
-				else {
-					// Area light requires different routine
-					AreaLight* light = dynamic_cast<AreaLight*>(scene.lights[i].get());
-
-					light->setPoints();
-					float areaIntensity = 0;
-					lightIntensity = light->color * std::min(1.0f, (float)(light->intensity / (4 * M_PI * (hitPoint - light->pos).length2() / 1000)));
-
-					float specularSum = 0;
-					float diffuseSum = 0;
-					// Add all light samples
-					for (const auto& p : light->points) {
-						lightDir = hitPoint - p;
-						intrShadInfo.tNear = lightDir.length();
-						bool vis = !trace(Ray{ hitPoint + hitNormal * scene.options.bias, -lightDir.normalize(), RayType::ShadowRay }, scene.objects, intrShadInfo);
-						Vec3f reflectedRay = reflect(lightDir, hitNormal);
-						specularSum += vis * std::max(0.f, reflectedRay.dotProduct(-ray.dir));
-					}
-					specularComponent += std::pow(specularSum / light->points.size(), intrInfo.hitObject->nSpecular) * lightIntensity;
-				}
-			}
-			hitColor += specularComponent;
-		}
-		else if (intrInfo.hitObject->materialType == MaterialType::Transparent) {
-			float kr = fresnel(ray.dir, hitNormal, intrInfo.hitObject->indexOfRefraction);
-			bool outside = ray.dir.dotProduct(hitNormal) < 0;
-			Vec3f biasVec = scene.options.bias * hitNormal;
-			hitColor = { 0 };
-			if (kr < 1) {
-				// Compute refraction if it is not a case of total internal reflection
-				Vec3f refractionDirection = refract(ray.dir, hitNormal, intrInfo.hitObject->indexOfRefraction).normalize();
-				Vec3f refractionRayOrig = outside ? hitPoint - biasVec : hitPoint + biasVec; // add bias
-				Vec3f refractionColor = castRay(Ray{ refractionRayOrig, refractionDirection }, scene, depth + 1);
-				hitColor += refractionColor * (1 - kr);
-			}
-
-			Vec3f reflectionDirection = reflect(ray.dir, hitNormal).normalize();
-			Vec3f reflectionRayOrig = outside ? hitPoint + biasVec : hitPoint - biasVec;    // add bias
-			Vec3f reflectionColor = castRay(Ray{ reflectionRayOrig, reflectionDirection }, scene, depth + 1);
-			hitColor += reflectionColor * kr;
-
-			// Add light reflections
-			specularComponent = 0;
-			for (uint32_t i = 0; i < scene.lights.size(); ++i) {
-				if (scene.lights[i]->type != LightType::AreaLight) {
-					scene.lights[i]->illuminate(hitPoint, lightDir, lightIntensity, intrShadInfo.tNear);
-					bool vis = !trace(Ray{ hitPoint + hitNormal * scene.options.bias, -lightDir, RayType::ShadowRay }, scene.objects, intrShadInfo);
-					Vec3f reflectedRay = reflect(lightDir, hitNormal);
-					specularComponent += vis * lightIntensity * std::pow(std::max(0.f, reflectedRay.dotProduct(-ray.dir)), intrInfo.hitObject->nSpecular);
-				}
-				else {
-					// Area light requires different routine
-					AreaLight* light = dynamic_cast<AreaLight*>(scene.lights[i].get());
-
-					light->setPoints();
-					float areaIntensity = 0;
-					lightIntensity = light->color * std::min(1.0f, (float)(light->intensity / (4 * M_PI * (hitPoint - light->pos).length2() / 1000)));
-
-					float specularSum = 0;
-					float diffuseSum = 0;
-					// Add all light samples
-					for (const auto& p : light->points) {
-						lightDir = hitPoint - p;
-						intrShadInfo.tNear = lightDir.length();
-						bool vis = !trace(Ray{ hitPoint + hitNormal * scene.options.bias, -lightDir.normalize(), RayType::ShadowRay }, scene.objects, intrShadInfo);
-						Vec3f reflectedRay = reflect(lightDir, hitNormal);
-						specularSum += vis * std::max(0.f, reflectedRay.dotProduct(-ray.dir));
-					}
-					specularComponent += std::pow(specularSum / light->points.size(), intrInfo.hitObject->nSpecular) * lightIntensity;
-				}
-			}
-			hitColor += specularComponent * kr;
-		}
-		
-		return hitColor;
-	}
-	return scene.getSkybox(ray.dir);
-}
+// classed describing scene and camera
+#include "scene.h"
+
+#include <algorithm>
+#include <thread>
+#include <cstring>
+#include <future>
+#include <unordered_set>
+
+#include "timer.h"
+#include "util.h"
+#include "options.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "parser.h"
+#include "image.h"
+#include "checkpoint.h"
+#include "time_budget.h"
+#include "profiler.h"
+
+Camera::Camera(const Vec3f& a_pos, const Vec3f& a_rot)
+	: pos(a_pos), rot(a_rot)
+{
+	update();
+}
+
+Camera& Camera::update()
+{
+	rMatrix = rotationMatrix(rot);
+	return *this;
+}
+
+Ray Camera::getRay(const float xPix, const  float yPix) const
+{
+	// Rotate camera direction
+	Vec3f dir = rMatrix.multVecMatrix(Vec3f(xPix, yPix, -1).normalize());
+	return Ray{ this->pos , dir };
+}
+
+
+Scene::Scene() {}
+
+Scene::Scene(const std::string& sceneName)
+{
+	sceneLoadSuccess = this->loadScene(sceneName);
+}
+
+Scene::~Scene()
+{
+	for (int k = 0; k < 6; k++)
+		delete[] skyboxes[k];
+}
+
+void Scene::addObject(std::unique_ptr<Object> object)
+{
+	objects.push_back(std::move(object));
+}
+
+void Scene::addLight(std::unique_ptr<Light> light)
+{
+	lights.push_back(std::move(light));
+}
+
+bool Scene::loadScene(const std::string& scenePath)
+{
+	return loadAssets(scenePath, [&](SceneParser& parser) { return parser.parse(scenePath); });
+}
+
+bool Scene::loadSceneText(std::string_view text, const std::string& name)
+{
+	return loadAssets(name, [&](SceneParser& parser) { return parser.parseText(text, name); });
+}
+
+bool Scene::loadAssets(const std::string& scenePath, const std::function<bool(SceneParser&)>& parse)
+{
+	PROFILE_ZONE("Load scene");
+	if (options.enableOutput) {
+		std::cout << "Loading scene " << scenePath << '\n';
+	}
+
+	// Meshes, textures and skybox are loaded concurrently, each load is recorded
+	// as a future and all of them are joined before scene is considered loaded
+	ThreadPool& loaders = workerPool();
+	std::vector<std::future<bool>> pendingLoads;
+	SceneParser parser(*this, loaders, pendingLoads);
+	{
+		PROFILE_ZONE("Parse scene");
+		if (!parse(parser)) {
+			loadError = "scene could not be parsed";
+			return false;
+		}
+	}
+
+	// Skybox faces are loaded while meshes and textures are still in progress
+	bool success = true;
+	if (options.useSkybox) {
+		success = loadSkybox(loaders);
+	}
+
+	// Wait for all assets, scene is loaded only if every asset is loaded
+	PROFILE_ZONE("Wait for assets");
+	for (auto& load : pendingLoads)
+		success = load.get() && success;
+	if (!success) {
+		loadError = "scene has assets that failed to load";
+		std::cout << "Scene " << scenePath << " has assets that failed to load\n";
+	}
+	return success;
+}
+
+bool Scene::loadSkybox(ThreadPool& loaders)
+{
+	// Load skybox faces and transform them to Vec3f, each face is a separate task
+	bool success = true;
+	if (options.useSkybox) {
+		std::vector<std::future<bool>> faceLoads;
+		int widths[6], heights[6];
+		for (int k = 0; k < 6; k++) {
+			faceLoads.push_back(loaders.submit([this, k, &widths, &heights]() {
+				PROFILE_ZONE("Load skybox face");
+				int& width = widths[k];
+				int& height = heights[k];
+				// Face is charged to memory before it is loaded
+				if (readBMPSize(options.names[k], width, height) && !stats.memory.reserve(MemoryCategory::Skybox,
+					options.names[k], std::abs(width) * (size_t)std::abs(height) * sizeof(Vec3f), options.memoryBudget))
+					return false;
+				unsigned char* data = loadBMP(options.names[k], width, height);
+				if (data == nullptr)
+					return false;
+				skyboxes[k] = new Vec3f[width * (size_t)height];
+				for (int i = 0; i < height; i++) {
+					for (int j = 0; j < width; j++) {
+						int v = 3 * (i * width + j);
+						float x = data[v], y = data[v + 1], z = data[v + 2];
+						x /= 256; y /= 256; z /= 256;
+						skyboxes[k][i * width + j] = Vec3f{ x, y, z };
+					}
+				}
+				delete[] data;
+				return true;
+			}));
+		}
+
+		// Faces share dimensions, which are needed only after all faces are loaded
+		for (auto& load : faceLoads)
+			success = load.get() && success;
+		skyboxWidth = widths[0];
+		skyboxHeight = heights[0];
+		for (int k = 1; k < 6 && success; k++) {
+			if (widths[k] != skyboxWidth || heights[k] != skyboxHeight) {
+				std::cout << "Skybox faces have different dimensions: " << options.names[k] << '\n';
+				success = false;
+			}
+		}
+	}
+	return success;
+}
+
+ThreadPool& Scene::workerPool() const
+{
+	return pool ? *pool : ThreadPool::shared();
+}
+
+TreeShape Scene::treeShape() const
+{
+	TreeShape shape;
+	std::unordered_set<const MeshGeometry*> seen;
+	for (const auto& object : objects) {
+		if (object->objectType != ObjectType::Mesh)
+			continue;
+		const MeshGeometry* geometry = static_cast<const Mesh&>(*object).geometry.get();
+		if (geometry && geometry->ac && seen.insert(geometry).second) {
+			shape.trees++;
+			geometry->ac->addShape(shape);
+		}
+	}
+	return shape;
+}
+
+void Scene::reportStatistics(const Options& settings) const
+{
+	const TreeShape shape = treeShape();
+	stats.print(shape);
+	const std::string path = settings.imageName + "_stats.json";
+	if (!stats.writeJSON(path, shape))
+		std::cout << "Could not write statistics " << path << '\n';
+	else if (settings.enableOutput)
+		std::cout << "Statistics written to " << path << '\n';
+}
+
+
+RenderContext::RenderContext(Scene& a_scene)
+	: options(a_scene.options), sampler(a_scene.options.samplerType),
+	compiled(a_scene, options, Camera(a_scene.camera).update()),
+	stats(a_scene.stats), pool(a_scene.workerPool()), onProgress(a_scene.onProgress), stop(a_scene.stop)
+{
+	if (options.costMap && !options.showAC)
+		costs = std::make_unique<CostMap>(options.width, options.height);
+	if (options.objectCosts && !options.showAC)
+		objectCosts = std::make_unique<ObjectCosts>(compiled.objects.size());
+}
+
+Vec3f RenderContext::getSkybox(const Vec3f& dir) const
+{
+	if (!options.useSkybox) {
+		return options.backgroundColor;
+	}
+
+	auto toPixel = [](const float& v, const int& max)
+	{
+		int val = (int)((v + 1.0f) / 2.0f * max);
+		if (val >= max) val = max - 1;
+		return val;
+	};
+
+	
+	// Get color from one of six skyboxes
+	Vec3f adir = dir;
+	float max = std::max(fabs(adir.x), std::max(fabs(adir.y), fabs(adir.z)));
+	if (max == fabs(adir.z)) {
+		if (adir.z < 0) {
+			adir = dir * (1 / -dir.z);
+			int i = toPixel(adir.y, compiled.skyboxHeight);
+			int j = toPixel(adir.x, compiled.skyboxWidth);
+			return compiled.skyboxes[1][i * compiled.skyboxWidth + j];
+		}
+		else {
+			adir = dir * (1 / dir.z);
+			int i = toPixel(adir.y, compiled.skyboxHeight);
+			int j = toPixel(-adir.x, compiled.skyboxWidth);
+			return compiled.skyboxes[3][i * compiled.skyboxWidth + j];
+		}
+	}
+	else if (max == fabs(adir.x)) {
+		if (adir.x < 0) {
+			adir = dir * (1 / -dir.x);
+			int i = toPixel(adir.y, compiled.skyboxHeight);
+			int j = toPixel(-adir.z, compiled.skyboxWidth);
+			return compiled.skyboxes[0][i * compiled.skyboxWidth + j];
+		}
+		else {
+			adir = dir * (1 / dir.x);
+			int i = toPixel(adir.y, compiled.skyboxHeight);
+			int j = toPixel(adir.z, compiled.skyboxWidth);
+			return compiled.skyboxes[2][i * compiled.skyboxWidth + j];
+		}
+	}
+	else {
+		if (adir.y < 0) {
+			adir = dir * (1 / -dir.y);
+			int i = toPixel(adir.z, compiled.skyboxHeight);
+			int j = toPixel(adir.x, compiled.skyboxWidth);
+			return compiled.skyboxes[5][i * compiled.skyboxWidth + j];
+		}
+		else {
+			adir = dir * (1 / dir.y);
+			int i = toPixel(adir.z, compiled.skyboxHeight);
+			int j = toPixel(adir.x, compiled.skyboxWidth);
+			return compiled.skyboxes[4][i * compiled.skyboxWidth + j];
+		}
+	}
+
+	return options.backgroundColor;
+}
+
+Vec3f RenderContext::traceSample(float x, float y, PixelSampler& pixelSampler, TraceState& state) const
+{
+	Ray ray = compiled.camera.getRay(x, y, options.width, options.height);
+	return Render::castRay(ray, *this, 0, pixelSampler, state);
+}
+
+Vec3f RenderContext::renderPixel(size_t x, size_t y, TraceState& state) const
+{
+	const CostMap::Start start = costs ? costs->begin(state.counters) : CostMap::Start{};
+	PixelSampler pixelSampler(sampler, (uint32_t)x, (uint32_t)y);
+	// Without anti-aliasing ray is cast through pixel center
+	const Vec3f color = state.quality.antialiasing ? renderPixelAdaptive(x, y, pixelSampler, state)
+		: traceSample(x + 0.5f, y + 0.5f, pixelSampler, state);
+	if (costs)
+		costs->end(x, y, start, state.counters);
+	return color;
+}
+
+namespace
+{
+	// Weight of sample with given offset from pixel center
+	float filterWeight(const FilterType filter, const float halfWidth, const float dx, const float dy)
+	{
+		if (filter == FilterType::Tent)
+			return std::max(0.0f, 1 - fabsf(dx) / halfWidth) * std::max(0.0f, 1 - fabsf(dy) / halfWidth);
+		if (filter == FilterType::Gaussian)
+			return expf(-2 * (dx * dx + dy * dy) / (halfWidth * halfWidth));
+		return 1.0f;
+	}
+
+	float luminance(const Vec3f& color)
+	{
+		return 0.2126f * clamp(0, 1, color.x) + 0.7152f * clamp(0, 1, color.y) + 0.0722f * clamp(0, 1, color.z);
+	}
+}
+
+Vec3f RenderContext::renderPixelAdaptive(size_t x, size_t y, PixelSampler& pixelSampler, TraceState& state) const
+{
+	// Samples are spread over filter support, centered in the pixel
+	const int minSamples = std::max(1, options.aaMinSamples);
+	const int maxSamples = std::max(minSamples, state.quality.aaMaxSamples);
+	const float width = std::max(options.aaFilterWidth, 1e-3f);
+	const float maxError2 = options.aaThreshold * options.aaThreshold;
+
+	Vec3f colorSum = 0;
+	float weightSum = 0;
+	float mean = 0, m2 = 0;	// running luminance variance (Welford)
+	int n = 0;
+	while (n < maxSamples) {
+		// After every batch stop if standard error of the pixel is low enough
+		if (n >= minSamples && n > 1 && n % minSamples == 0 && m2 / (n - 1) / n <= maxError2)
+			break;
+
+		Vec2f offset = pixelSampler.pixelOffset(n);
+		const float dx = (offset.x - 0.5f) * width;
+		const float dy = (offset.y - 0.5f) * width;
+		pixelSampler.startSample(n);
+		Vec3f color = traceSample(x + 0.5f + dx, y + 0.5f + dy, pixelSampler, state);
+		const float weight = filterWeight(options.aaFilter, width / 2, dx, dy);
+		colorSum += color * weight;
+		weightSum += weight;
+
+		n++;
+		const float lum = luminance(color);
+		const float delta = lum - mean;
+		mean += delta / n;
+		m2 += delta * (lum - mean);
+	}
+
+	if (options.collectStatistics) {
+		state.counters.pixelSamples += n;
+	}
+	return weightSum > 0 ? colorSum / weightSum : Vec3f{ 0 };
+}
+
+size_t RenderContext::tileCount() const
+{
+	const size_t tileSize = std::max(1, options.tileSize);
+	return ((options.width + tileSize - 1) / tileSize) * ((options.height + tileSize - 1) / tileSize);
+}
+
+void RenderContext::tileRect(size_t tile, size_t& x0, size_t& y0, size_t& x1, size_t& y1) const
+{
+	const size_t tileSize = std::max(1, options.tileSize);
+	const size_t tilesX = (options.width + tileSize - 1) / tileSize;
+	x0 = tile % tilesX * tileSize;
+	x1 = std::min(x0 + tileSize, options.width);
+	y0 = tile / tilesX * tileSize;
+	y1 = std::min(y0 + tileSize, options.height);
+}
+
+bool RenderContext::renderTiles(Vec3f* frameBuffer, const TileCallback& onTile, size_t firstTile, size_t lastTile)
+{
+	// Workers take tiles in row-major order from shared counter, so that load
+	// stays balanced, and every finished tile is passed on right away
+	const size_t tileSize = std::max(1, options.tileSize);
+	const size_t endTile = std::min(lastTile, tileCount());
+	std::unique_ptr<TimeBudget> budget;
+	if (options.timeBudget > 0) {
+		budget = std::make_unique<TimeBudget>(*this, firstTile, endTile);
+		budget->pilot();
+	}
+
+	std::atomic<size_t> nextTile{ firstTile };
+	std::atomic<bool> stopped{ false };
+	launchWorkers([&](size_t, TraceState& state) {
+		// Without frame buffer every worker renders into its own tile buffer
+		std::vector<Vec3f> tileBuffer(frameBuffer ? 0 : tileSize * tileSize);
+		MemoryCharge tileCharge(stats.memory, MemoryCategory::FrameBuffer, "render");
+		tileCharge.reserve(tileBuffer.size() * sizeof(Vec3f));
+		for (size_t tile = nextTile++; tile < endTile; tile = nextTile++) {
+			// Tiles in flight are finished when render is stopped
+			if (stop && stop->load()) {
+				stopped = true;
+				break;
+			}
+			PROFILE_ZONE("Render tile");
+			size_t x0, y0, x1, y1;
+			tileRect(tile, x0, y0, x1, y1);
+			if (tile < skipTiles.size() && skipTiles[tile]) {
+				finishedPixels += (x1 - x0) * (y1 - y0);
+				continue;
+			}
+			const size_t level = budget ? budget->level() : 0;
+			if (budget)
+				state.quality = budget->quality(level);
+			Vec3f* pixels = frameBuffer ? frameBuffer + x0 + y0 * options.width : tileBuffer.data();
+			const size_t stride = frameBuffer ? options.width : x1 - x0;
+			auto tileStart = std::chrono::steady_clock::now();
+			for (size_t y = y0; y < y1; y++) {
+				for (size_t x = x0; x < x1; x++) {
+					pixels[(x - x0) + (y - y0) * stride] = renderPixel(x, y, state);
+					finishedPixels++;
+				}
+			}
+			if (budget)
+				budget->tileFinished(tile, level, std::chrono::steady_clock::now() - tileStart);
+			if (onTile)
+				onTile(pixels, stride, x0, y0, x1, y1);
+		}
+	});
+	if (budget && options.enableOutput)
+		budget->report();
+	return !stopped;
+}
+
+void RenderContext::renderPassWorker(Vec3f* frameBuffer, size_t y0, size_t y1, size_t step,
+	size_t prevStep, size_t worker, TraceState& state)
+{
+	// Rows are interleaved between workers, as sparse rows have very different cost
+	size_t row = 0;
+	for (size_t y = y0; y < y1; y += step, row++) {
+		if (row % options.nWorkers != worker)
+			continue;
+		for (size_t x = 0; x < options.width; x += step) {
+			// Pixel was traced in one of previous passes
+			if (prevStep != 0 && x % prevStep == 0 && y % prevStep == 0)
+				continue;
+
+			// Replicate traced pixel over its block, until later passes refine it
+			Vec3f color = renderPixel(x, y, state);
+			for (size_t by = y; by < std::min(y + step, options.height); by++)
+				for (size_t bx = x; bx < std::min(x + step, options.width); bx++)
+					frameBuffer[bx + by * options.width] = color;
+			finishedPixels++;
+		}
+	}
+}
+
+void RenderContext::renderProgressive(Vec3f* frameBuffer)
+{
+	// First pass step is rounded down to power of two, so that every pass halves it
+	size_t firstStep = 1;
+	while (firstStep * 2 <= (size_t)std::max(1, options.progressiveStep))
+		firstStep *= 2;
+
+	// Passes are split in slices of rows, intermediate image may be written between
+	// slices. Slice height is multiple of every step, so that blocks do not cross slices
+	size_t sliceRows = (options.height / 8 + firstStep - 1) / firstStep * firstStep;
+	sliceRows = std::max(sliceRows, firstStep);
+
+	auto lastWrite = std::chrono::high_resolution_clock::now();
+	size_t prevStep = 0;
+	for (size_t step = firstStep; step > 0; prevStep = step, step /= 2) {
+		for (size_t y0 = 0; y0 < options.height; y0 += sliceRows) {
+			size_t y1 = std::min(options.height, y0 + sliceRows);
+			launchWorkers([&](size_t worker, TraceState& state) {
+				PROFILE_ZONE("Render pass slice");
+				renderPassWorker(frameBuffer, y0, y1, step, prevStep, worker, state);
+			});
+
+			// Final image is written by render
+			bool lastSlice = step == 1 && y1 == options.height;
+			auto now = std::chrono::high_resolution_clock::now();
+			if (options.imageOutput && !lastSlice &&
+				std::chrono::duration_cast<std::chrono::milliseconds>(now - lastWrite).count() >= options.progressiveInterval) {
+				saveImage(frameBuffer, options);
+				lastWrite = std::chrono::high_resolution_clock::now();
+			}
+		}
+	}
+}
+
+void RenderContext::launchWorkers(const std::function<void(size_t, TraceState&)>& work)
+{
+	// Every worker is a task on the pool, with its own counters that are
+	// merged into scene statistics once the worker is finished
+	std::vector<std::future<void>> workers;
+	for (size_t i = 0; i < (size_t)options.nWorkers; i++) {
+		workers.push_back(pool.submit([this, &work, i]() {
+			PROFILE_ZONE("Render worker");
+			PerfScope perf(stats, PerfPhase::Render, options.perfCounters);
+			Counters counters;
+			std::unique_ptr<WorkerCosts> costs = objectCosts ? std::make_unique<WorkerCosts>(compiled.objects.size()) : nullptr;
+			TraceState state{ options, counters, Quality(options),
+				options.collectStatistics || options.costMap || options.objectCosts, 0, costs.get() };
+			work(i, state);
+			stats.add(counters);
+			if (costs)
+				objectCosts->add(*costs);
+		}));
+	}
+
+	// Until all workers finish we will print progress
+	auto lastReport = std::chrono::high_resolution_clock::now();
+	for (auto& worker : workers) {
+		while (worker.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready) {
+			auto now = std::chrono::high_resolution_clock::now();
+			if ((options.outputProgress || onProgress) && std::chrono::duration_cast<std::chrono::milliseconds>(now - lastReport).count() >= 1000ll) {
+				const float progressCoef = 100.0f / (options.width * options.height);
+				if (options.outputProgress)
+					std::cout << std::fixed << std::setw(2) << std::setprecision(0) << progressCoef * finishedPixels.load() << "%\n";
+				if (onProgress)
+					onProgress(progressCoef * finishedPixels.load());
+				lastReport = now;
+			}
+		}
+		worker.get();
+	}
+}
+
+void RenderContext::renderFrame(Vec3f* frameBuffer)
+{
+	if (options.showAC)
+		renderAC(frameBuffer);
+	else if (options.progressive)
+		renderProgressive(frameBuffer);
+	else
+		renderTiles(frameBuffer, nullptr);
+}
+
+long long Scene::render(Vec3f* frameBuffer)
+{
+	if (!sceneLoadSuccess) return -1;
+	PROFILE_ZONE("Render");
+	RenderContext ctx(*this);
+	Timer t("Render scene", ctx.options.enableOutput);
+	ctx.renderFrame(frameBuffer);
+	return t.stop();
+}
+
+long long Scene::render(const TileCallback& onTile)
+{
+	if (!sceneLoadSuccess) return -1;
+	PROFILE_ZONE("Render");
+	RenderContext ctx(*this);
+	Timer t("Render scene", ctx.options.enableOutput);
+	return ctx.renderTiles(nullptr, onTile) ? t.stop() : -1;
+}
+
+long long Scene::render()
+{
+	if (!sceneLoadSuccess) return -1;
+	PROFILE_ZONE("Render");
+	RenderContext ctx(*this);
+	const Options& settings = ctx.options;
+	Timer t("Total time", settings.enableOutput);
+	// Tiled frame buffer keeps only tiles in flight, image is assembled in output file
+	const bool tiled = settings.tiledFramebuffer && !settings.progressive && !settings.showAC;
+	if (settings.tiledFramebuffer && !tiled)
+		std::cout << "Tiled frame buffer is not supported by progressive mode and showAC, whole frame is kept in memory\n";
+	if (settings.checkpoint && (settings.progressive || settings.showAC))
+		std::cout << "Checkpoints are not supported by progressive mode and showAC\n";
+	// Buffers are charged to memory before render starts, so that render over budget fails right away
+	std::unique_ptr<Vec3f[]> frameBuffer;
+	MemoryCharge frameCharge(stats.memory, MemoryCategory::FrameBuffer, "render");
+	MemoryCharge outputCharge(stats.memory, MemoryCategory::OutputBuffer, "render");
+	if (!frameCharge.reserve(tiled ? 0 : settings.height * settings.width * sizeof(Vec3f), settings.memoryBudget) ||
+		!outputCharge.reserve(settings.imageOutput ? ImageWriter::dataSize(settings.width, settings.height, settings.imageFormat) : 0,
+			settings.memoryBudget))
+		return -1;
+	if (!tiled)
+		frameBuffer.reset(new Vec3f[settings.height * settings.width]);
+	int imageSaved = 1;	// 1 until image is written, then result of writing it
+
+	if (settings.showAC || settings.progressive) {
+		Timer t("Render scene", settings.enableOutput);
+		ctx.renderFrame(frameBuffer.get());
+	}
+	else {
+		// Tiles are streamed to output file while the rest of image is rendered
+		std::unique_ptr<ImageWriter> writer;
+		if (settings.imageOutput) {
+			writer = std::make_unique<ImageWriter>(imagePath(settings), settings.width, settings.height, settings.imageFormat);
+			if (!writer->good()) {
+				std::cout << "Could not open output file " << writer->path << '\n';
+				writer.reset();
+				imageSaved = -1;
+			}
+		}
+		// Tiles of previous render are copied to frame buffer and output file like rendered ones
+		std::unique_ptr<TileCheckpoint> checkpoint;
+		if (settings.checkpoint) {
+			checkpoint = std::make_unique<TileCheckpoint>(settings, sourceHash, camera);
+			const size_t restored = checkpoint->open(settings.resume, ctx.skipTiles,
+				[&](const Vec3f* pixels, size_t stride, size_t x0, size_t y0, size_t x1, size_t y1) {
+				for (size_t y = y0; frameBuffer && y < y1; y++)
+					std::copy(pixels + (y - y0) * stride, pixels + (y - y0) * stride + (x1 - x0), &frameBuffer[y * settings.width + x0]);
+				if (writer)
+					writer->writeTile(pixels, stride, x0, y0, x1, y1);
+			});
+			if (!checkpoint->good()) {
+				std::cout << "Could not open checkpoint " << checkpoint->path << '\n';
+				checkpoint.reset();
+			}
+			else if (settings.resume && settings.enableOutput) {
+				std::cout << "Resumed " << restored << " of " << ctx.skipTiles.size() << " tiles from " << checkpoint->path << '\n';
+			}
+		}
+		bool finished;
+		{
+			Timer t("Render scene", settings.enableOutput);
+			finished = ctx.renderTiles(frameBuffer.get(), [&](const Vec3f* pixels, size_t stride, size_t x0, size_t y0, size_t x1, size_t y1) {
+				if (writer)
+					writer->writeTile(pixels, stride, x0, y0, x1, y1);
+				if (checkpoint)
+					checkpoint->add(pixels, stride, x0, y0, x1, y1);
+			});
+		}
+		if (checkpoint) {
+			if (finished)
+				checkpoint->remove();
+			else if (checkpoint->flush())
+				std::cout << "Render stopped, finished tiles are saved in " << checkpoint->path << '\n';
+			else
+				std::cout << "Render stopped, could not write checkpoint " << checkpoint->path << '\n';
+		}
+		if (!finished) {
+			// Image is not finished, partial output file is rewritten when render resumes
+			if (writer)
+				writer->close();
+			return -1;
+		}
+		if (writer) {
+			imageSaved = writer->close() ? 0 : -1;
+			if (imageSaved != 0)
+				std::cout << "Could not write output file " << writer->path << '\n';
+			else if (settings.enableOutput)
+				std::cout << "Successfully wrote to output file " << writer->path << '\n';
+		}
+	}
+
+	// Image viewer is opened only on request, by default rendering is headless
+	if (settings.imageOutput) {
+		if (imageSaved > 0)
+			imageSaved = saveImage(frameBuffer.get(), settings);
+		if (imageSaved == 0 && settings.openImage)
+			openImage(imagePath(settings));
+	}
+
+	if (ctx.costs) {
+		if (settings.enableOutput)
+			ctx.costs->report();
+		ctx.costs->write(settings);
+	}
+	if (ctx.objectCosts)
+		ctx.objectCosts->report(ctx.compiled);
+	if (settings.memoryReport)
+		stats.memory.print(settings.memoryBudget);
+
+	if (settings.collectStatistics) {
+		reportStatistics(settings);
+	}
+	else if (settings.perfCounters) {
+		stats.printPerf();
+	}
+
+	if (settings.enableOutput) {
+		std::cout << '\n';
+	}
+	return t.stop();
+}
+
+void Scene::setFrame(int frame)
+{
+	PROFILE_ZONE("Set frame");
+	if (!animation.cameraPos.empty())
+		camera.pos = animation.cameraPos.at(frame);
+	if (!animation.cameraRot.empty())
+		camera.rot = animation.cameraRot.at(frame);
+
+	// Spheres and planes are just moved, meshes move their triangles and
+	// refit acceleration structures as pool tasks, one mesh after another
+	for (const ObjectMotion& motion : animation.objects) {
+		if (motion.object >= objects.size())
+			continue;
+		Object* object = objects[motion.object].get();
+		const Vec3f pos = motion.pos.empty() ? object->pos : motion.pos.at(frame);
+		if (object->objectType == ObjectType::Mesh) {
+			Mesh* mesh = static_cast<Mesh*>(object);
+			const Vec3f rot = motion.rot.empty() ? mesh->rot : motion.rot.at(frame);
+			mesh->setTransform(pos, rot, options, stats, workerPool());
+		}
+		else {
+			object->pos = pos;
+		}
+	}
+}
+
+long long Scene::renderAnimation()
+{
+	if (!sceneLoadSuccess) return -1;
+	Timer t("Total time", options.enableOutput);
+	if (options.tiledFramebuffer)
+		std::cout << "Tiled frame buffer is not supported by animation, whole frame is kept in memory\n";
+
+	// Frame buffer is handed over to background write, so that at most two
+	// frames are in memory: one being written and one being rendered
+	const std::string imageName = options.imageName;
+	const int digits = (int)std::to_string(std::max(std::abs(animation.firstFrame), std::abs(animation.lastFrame))).size();
+	std::future<int> pendingWrite;
+	// Object costs are summed over all frames
+	std::unique_ptr<ObjectCosts> objectCosts;
+	for (int frame = animation.firstFrame; frame <= animation.lastFrame; frame++) {
+		setFrame(frame);
+		std::string number = std::to_string(std::abs(frame));
+		options.imageName = imageName + '_' + (frame < 0 ? "-" : "") + std::string(digits - number.size(), '0') + number;
+		RenderContext ctx(*this);
+		// Frame buffer stays charged until its frame is written
+		auto frameCharge = std::make_unique<MemoryCharge>(stats.memory, MemoryCategory::FrameBuffer, "render");
+		if (!frameCharge->reserve(options.width * options.height * sizeof(Vec3f), options.memoryBudget)) {
+			if (pendingWrite.valid())
+				pendingWrite.get();
+			options.imageName = imageName;
+			return -1;
+		}
+		std::unique_ptr<Vec3f[]> frameBuffer(new Vec3f[options.width * options.height]);
+		{
+			PROFILE_ZONE("Render frame");
+			Timer t("Frame " + std::to_string(frame), options.enableOutput);
+			ctx.renderFrame(frameBuffer.get());
+		}
+		if (ctx.costs)
+			ctx.costs->write(ctx.options);
+		if (ctx.objectCosts && objectCosts)
+			objectCosts->add(*ctx.objectCosts);
+		else if (ctx.objectCosts)
+			objectCosts = std::move(ctx.objectCosts);
+
+		if (pendingWrite.valid())
+			pendingWrite.get();
+		if (ctx.options.imageOutput) {
+			pendingWrite = std::async(std::launch::async, [this, frameBuffer = std::move(frameBuffer),
+				frameCharge = std::move(frameCharge), frameOptions = ctx.options]() {
+				MemoryCharge outputCharge(stats.memory, MemoryCategory::OutputBuffer, "render");
+				outputCharge.reserve(ImageWriter::dataSize(frameOptions.width, frameOptions.height, frameOptions.imageFormat));
+				return saveImage(frameBuffer.get(), frameOptions);
+			});
+		}
+	}
+	if (pendingWrite.valid())
+		pendingWrite.get();
+	options.imageName = imageName;
+
+	if (objectCosts)
+		objectCosts->report(CompiledScene(*this, options, camera));
+	if (options.memoryReport)
+		stats.memory.print(options.memoryBudget);
+	if (options.collectStatistics) {
+		reportStatistics(options);
+	}
+	else if (options.perfCounters) {
+		stats.printPerf();
+	}
+	if (options.enableOutput) {
+		std::cout << '\n';
+	}
+	return t.stop();
+}
+
+void RenderContext::renderAC(Vec3f* frameBuffer)
+{
+	Counters counters;
+	TraceState state{ options, counters, Quality(options), options.collectStatistics };
+	int acMax = 0;
+	int* acBuffer = new int[options.width * options.height];
+
+	for (size_t y = 0; y < options.height; y++) {
+		for (size_t x = 0; x < options.width; x++) {
+			Ray ray = compiled.camera.getRay(x + 0.5f, y + 0.5f, options.width, options.height);
+			int val = countAC(ray, state);
+			if (val > acMax) acMax = val;
+			acBuffer[x + y * options.width] = val;
+		}
+	}
+
+	for (size_t y = 0; y < options.height; y++) {
+		for (size_t x = 0; x < options.width; x++) {
+			float val = (float)acBuffer[x + y * options.width];
+			val /= acMax;
+			frameBuffer[x + y * options.width] = Vec3f{ val };
+		}
+	}
+	delete[] acBuffer;
+}
+
+int RenderContext::countAC(const Ray& ray, TraceState& state) const
+{
+	int sum = 0;
+	for (const ObjectRecord& object : compiled.objects) {
+		if (object.ac)
+			sum += object.ac->recCountAC(ray, state);
+	}
+	return sum;
+}
+
+
+Vec3f Render::reflect(const Vec3f& dir, const Vec3f& normal)
+{
+	return dir - 2 * dir.dotProduct(normal) * normal;
+}
+
+Vec3f Render::refract(const Vec3f& dir, const Vec3f& normal, const float& indexOfRefraction)
+{
+	float n1 = 1, n2 = indexOfRefraction;   // n1 - air, n2 - object
+	float cosi = clamp(-1, 1, dir.dotProduct(normal));
+	Vec3f modNormal = normal;
+	if (cosi < 0) {
+		// outside the medium
+		cosi = -cosi;
+	}
+	else {
+		// inside the medium
+		std::swap(n1, n2);
+		modNormal = -normal;
+	}
+	float rri = n1 / n2; // relative refraction index
+	float k = 1 - rri * rri * (1 - cosi * cosi); // critical angle test
+	if (k < 0)
+		return 0;
+	return rri * dir + (rri * cosi - sqrtf(k)) * modNormal;
+}
+
+float Render::fresnel(const Vec3f& dir, const Vec3f& normal, const float& indexOfRefraction)
+{
+	float n1 = 1, n2 = indexOfRefraction;   // n1 - air, n2 - object
+	float cosi = clamp(-1, 1, dir.dotProduct(normal));
+	if (cosi > 0) {
+		// outside the medium
+		std::swap(n1, n2);
+	}
+	float sint = n1 / n2 * sqrtf(std::max(0.f, 1 - cosi * cosi));  // Snell's law
+
+	float kr;
+	if (sint >= 1) {
+		// total internal reflection
+		kr = 1;
+	}
+	else {
+		// Fresnel equation
+		float cost = sqrtf(std::max(0.f, 1 - sint * sint));
+		cosi = fabsf(cosi);
+		float rs = ((n2 * cosi) - (n1 * cost)) / ((n2 * cosi) + (n1 * cost));
+		float rp = ((n1 * cosi) - (n2 * cost)) / ((n1 * cosi) + (n2 * cost));
+		kr = (rs * rs + rp * rp) / 2;
+	}
+	return kr;
+}
+
+namespace
+{
+	// Adds shading time of a hit to its object when it goes out of scope. Traces and
+	// shading of rays spawned meanwhile are measured on their own and subtracted
+	class ShadeTimer
+	{
+	public:
+		ShadeTimer(WorkerCosts* a_costs, size_t a_object) : costs(a_costs), object(a_object)
+		{
+			if (costs) {
+				start = CostMap::cycles();
+				traced = costs->traceCycles;
+				shaded = costs->shadeCycles;
+			}
+		}
+		~ShadeTimer()
+		{
+			if (!costs)
+				return;
+			const uint64_t elapsed = CostMap::cycles() - start;
+			const uint64_t nested = (costs->traceCycles - traced) + (costs->shadeCycles - shaded);
+			const uint64_t self = elapsed > nested ? elapsed - nested : 0;
+			costs->objects[object].shadeCycles += self;
+			costs->shadeCycles += self;
+		}
+
+	private:
+		WorkerCosts* const costs;
+		const size_t object;
+		uint64_t start = 0, traced = 0, shaded = 0;
+	};
+}
+
+bool Render::trace(const Ray& ray, const CompiledScene& scene, IntersectInfo& intrInfo, TraceState& state)
+{
+	// Try to intersect all objects, choose the closest one
+	if (state.countTests) {
+		state.counters.raysCasted++;
+		state.counters.raysByType[(int)ray.rayType]++;
+		state.counters.raysByDepth[std::min(state.depth, statDepths - 1)]++;
+	}
+	WorkerCosts* const costs = state.objectCosts;
+	intrInfo.hitObject = nullptr;
+	for (const ObjectRecord& object : scene.objects) {
+		if (ray.rayType == RayType::ShadowRay && !object.castsShadow)
+			continue;
+		float tNear = std::numeric_limits<float>::max();
+		const Triangle* ptr = nullptr;
+		Vec2f uv;
+
+		const uint64_t startCycles = costs ? CostMap::cycles() : 0;
+		const size_t startTriangleTests = state.counters.rayTriTests, startBoxTests = state.counters.accelStructTests;
+		bool hit;
+		if (object.type == ObjectType::Mesh)
+			hit = object.ac->intersectAccelStruct(ray, tNear, ptr, uv, state);
+		else if (object.type == ObjectType::Sphere)
+			hit = Sphere::intersect(ray, object.pos, object.r2, tNear);
+		else if (object.type == ObjectType::Plane)
+			hit = Plane::intersect(ray, object.pos, object.normal, tNear);
+		else
+			hit = object.object->intersectObject(ray, tNear, uv);
+		if (costs) {
+			ObjectCost& cost = costs->objects[&object - scene.objects.data()];
+			const uint64_t cycles = CostMap::cycles() - startCycles;
+			cost.intersectCycles += cycles;
+			cost.triangleTests += state.counters.rayTriTests - startTriangleTests;
+			cost.boxTests += state.counters.accelStructTests - startBoxTests;
+			costs->traceCycles += cycles;
+		}
+
+		if (hit && tNear < intrInfo.tNear) {
+			intrInfo.hitObject = &object;
+			intrInfo.tNear = tNear;
+			intrInfo.triPtr = ptr;
+			intrInfo.uv = uv;
+		}
+	}
+	if (costs && intrInfo.hitObject && ray.rayType != RayType::ShadowRay)
+		costs->objects[intrInfo.hitObject - scene.objects.data()].hits++;
+	return (intrInfo.hitObject != nullptr);
+}
+
+void Render::gatherLight(const RenderContext& ctx, const Vec3f& hitPoint, const Vec3f& hitNormal,
+	const Vec3f& viewDir, const MaterialRecord& material, PixelSampler& sampler, TraceState& state,
+	Vec3f& diffuse, Vec3f& specular)
+{
+	const CompiledScene& scene = ctx.compiled;
+	const bool withDiffuse = material.type == MaterialType::Diffuse || material.type == MaterialType::Phong;
+	const bool withSpecular = material.type != MaterialType::Diffuse;
+	const Vec3f shadowOrig = hitPoint + hitNormal * ctx.options.bias;
+	IntersectInfo intrShadInfo;
+
+	// Light coming from one direction, lightDir points from light to hit point
+	auto addLight = [&](const Vec3f& lightDir, const Vec3f& lightIntensity, const float distance) {
+		// Check that light source is visible
+		intrShadInfo.tNear = distance;
+		if (trace(Ray{ shadowOrig, -lightDir, RayType::ShadowRay }, scene, intrShadInfo, state))
+			return;
+		if (withDiffuse)
+			diffuse += lightIntensity * std::max(0.f, hitNormal.dotProduct(-lightDir));
+		if (withSpecular)
+			specular += lightIntensity * std::pow(std::max(0.f, reflect(lightDir, hitNormal).dotProduct(-viewDir)), material.nSpecular);
+	};
+
+	for (const DistantLightRecord& light : scene.distantLights)
+		addLight(light.dir, light.intensity, std::numeric_limits<float>::max());
+
+	for (const PointLightRecord& light : scene.pointLights) {
+		Vec3f lightDir = hitPoint - light.pos;
+		const float distance2 = lightDir.length2();
+		addLight(lightDir.normalize(), light.color * std::min(1.0f, light.power / distance2), sqrtf(distance2));
+	}
+
+	// Area lights average visibility of their samples, specular exponent is applied to the average
+	for (const AreaLightRecord& light : scene.areaLights) {
+		const uint32_t dimension = sampler.nextDimension();
+		const Vec3f lightIntensity = light.color * std::min(1.0f, light.power / (hitPoint - light.pos).length2());
+		// Lowered quality takes first samples of the set, or evenly spaced fixed points
+		const uint32_t sampleCount = std::min(light.sampleCount, state.quality.areaLightSamples);
+		float diffuseSum = 0, specularSum = 0;
+		for (uint32_t k = 0; k < sampleCount; k++) {
+			Vec3f lightDir;
+			if (light.fixedPoints) {
+				const uint32_t point = sampleCount < light.sampleCount ? (2 * k + 1) * light.sampleCount / (2 * sampleCount) : k;
+				lightDir = hitPoint - scene.areaPoints[light.firstPoint + point];
+			}
+			else {
+				const Vec2f uv = sampler.get2D(k, dimension);
+				lightDir = hitPoint - (light.pos + light.i * (uv.x - 0.5f) + light.j * (uv.y - 0.5f));
+			}
+			intrShadInfo.tNear = lightDir.length();
+			if (trace(Ray{ shadowOrig, -lightDir.normalize(), RayType::ShadowRay }, scene, intrShadInfo, state))
+				continue;
+			diffuseSum += std::max(0.f, hitNormal.dotProduct(-lightDir));
+			if (withSpecular)
+				specularSum += std::max(0.f, reflect(lightDir, hitNormal).dotProduct(-viewDir));
+		}
+		if (withDiffuse)
+			diffuse += diffuseSum / sampleCount * lightIntensity;
+		if (withSpecular)
+			specular += std::pow(specularSum / sampleCount, material.nSpecular) * lightIntensity;
+	}
+}
+
+Vec3f Render::castRay(const Ray& ray, const RenderContext& ctx, const int depth, PixelSampler& sampler,
+	TraceState& state)
+{
+	const Options& options = ctx.options;
+	if (depth > state.quality.maxRayDepth) return ctx.getSkybox(ray.dir);
+	state.depth = depth;
+	IntersectInfo intrInfo;
+	if (!trace(ray, ctx.compiled, intrInfo, state))
+		return ctx.getSkybox(ray.dir);
+
+	const ObjectRecord& object = *intrInfo.hitObject;
+	const MaterialRecord& material = ctx.compiled.materials[object.material];
+	const ShadeTimer shadeTimer(state.objectCosts, &object - ctx.compiled.objects.data());
+	Vec2f hitTexCoordinates;
+	Vec3f hitNormal, hitColor = { 0 };
+	// Get point coordinate and normal
+	Vec3f hitPoint = ray.orig + ray.dir * intrInfo.tNear;
+	object.object->getSurfaceData(hitPoint, intrInfo.triPtr, intrInfo.uv, hitNormal, hitTexCoordinates);
+
+	if (options.showNormals)
+		return hitNormal / 2.0f + Vec3f{ 0.5f };
+
+	// Textured meshes take color and specular coefficient from their maps
+	Vec3f objectColor = material.textures ? material.textures->getDiffuseColor(hitTexCoordinates) : material.color;
+
+	Vec3f diffuseComponent = 0, specularComponent = 0;
+	if (material.type == MaterialType::Diffuse) {
+		// For diffuse objects collect light from all visible sources
+		gatherLight(ctx, hitPoint, hitNormal, ray.dir, material, sampler, state, diffuseComponent, specularComponent);
+		hitColor = objectColor * diffuseComponent;
+	}
+	else if (material.type == MaterialType::Phong) {
+		// For Phong object we will combine colors of object color, diffuse and specular
+		gatherLight(ctx, hitPoint, hitNormal, ray.dir, material, sampler, state, diffuseComponent, specularComponent);
+		float specularCoefficient = material.textures ? material.textures->getSpecularValue(hitTexCoordinates) : material.specular;
+		hitColor = objectColor * material.ambient + diffuseComponent * material.diffuse + specularComponent * specularCoefficient;
+	}
+	else if (material.type == MaterialType::Reflective) {
+		// Get info from reflected ray
+		Ray reflectedRay{ hitPoint + options.bias * hitNormal, ray.dir - 2 * ray.dir.dotProduct(hitNormal) * hitNormal, RayType::ReflectionRay };
+
+		hitColor = 0.8f * castRay(reflectedRay, ctx, depth + 1, sampler, state);
+
+		// Add light reflections, shadow rays are counted at depth of this hit
+		state.depth = depth;
+		gatherLight(ctx, hitPoint, hitNormal, ray.dir, material, sampler, state, diffuseComponent, specularComponent);
+		hitColor += specularComponent;
+	}
+	else if (material.type == MaterialType::Transparent) {
+		float kr = fresnel(ray.dir, hitNormal, material.indexOfRefraction);
+		bool outside = ray.dir.dotProduct(hitNormal) < 0;
+		Vec3f biasVec = options.bias * hitNormal;
+		hitColor = { 0 };
+		if (kr < 1) {
+			// Compute refraction if it is not a case of total internal reflection
+			Vec3f refractionDirection = refract(ray.dir, hitNormal, material.indexOfRefraction).normalize();
+			Vec3f refractionRayOrig = outside ? hitPoint - biasVec : hitPoint + biasVec; // add bias
+			Vec3f refractionColor = castRay(Ray{ refractionRayOrig, refractionDirection, RayType::RefractionRay }, ctx, depth + 1, sampler, state);
+			hitColor += refractionColor * (1 - kr);
+		}
+
+		Vec3f reflectionDirection = reflect(ray.dir, hitNormal).normalize();
+		Vec3f reflectionRayOrig = outside ? hitPoint + biasVec : hitPoint - biasVec;    // add bias
+		Vec3f reflectionColor = castRay(Ray{ reflectionRayOrig, reflectionDirection, RayType::ReflectionRay }, ctx, depth + 1, sampler, state);
+		hitColor += reflectionColor * kr;
+
+		// Add light reflections, shadow rays are counted at depth of this hit
+		state.depth = depth;
+		gatherLight(ctx, hitPoint, hitNormal, ray.dir, material, sampler, state, diffuseComponent, specularComponent);
+		hitColor += specularComponent * kr;
+	}
+
+	return hitColor;
+}
@@ -0,0 +1,366 @@
+// Local render daemon, receives render jobs over a Unix domain socket
+#include "server.h"
+
+// Unix domain sockets are used only on POSIX systems
+#ifndef _WIN32
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <optional>
+#include <filesystem>
+#include <cstring>
+
+#include "scene.h"
+#include "timer.h"
+#include "util.h"
+
+namespace
+{
+	const size_t maxInlineScene = 64 << 20;	// bytes of scene text sent with a job
+
+	// Connected socket with buffered line reads. Writes never raise SIGPIPE, so a
+	// client that went away only makes its replies fail
+	class Connection
+	{
+	public:
+		Connection(int a_fd) : fd(a_fd) {}
+		~Connection() { close(fd); }
+		Connection(const Connection&) = delete;
+		Connection& operator=(const Connection&) = delete;
+
+		// Next line without line break, false once connection is closed
+		bool readLine(std::string& line)
+		{
+			size_t end;
+			while ((end = buffer.find('\n')) == std::string::npos) {
+				if (!fill())
+					return false;
+			}
+			line = buffer.substr(0, end);
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+			buffer.erase(0, end + 1);
+			return true;
+		}
+
+		bool read(size_t count, std::string& data)
+		{
+			while (buffer.size() < count) {
+				if (!fill())
+					return false;
+			}
+			data = buffer.substr(0, count);
+			buffer.erase(0, count);
+			return true;
+		}
+
+		bool send(const std::string& line)
+		{
+			const std::string data = line + '\n';
+			for (size_t sent = 0; sent < data.size();) {
+				ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+				if (n <= 0)
+					return false;
+				sent += n;
+			}
+			return true;
+		}
+
+	private:
+		bool fill()
+		{
+			char chunk[4096];
+			ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+			if (n <= 0)
+				return false;
+			buffer.append(chunk, n);
+			return true;
+		}
+
+		int fd;
+		std::string buffer;
+	};
+
+	bool socketAddress(const std::string& path, sockaddr_un& address)
+	{
+		if (path.size() >= sizeof(address.sun_path)) {
+			std::cout << "Socket path is too long: " << path << '\n';
+			return false;
+		}
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		strcpy(address.sun_path, path.c_str());
+		return true;
+	}
+}
+
+int listenSocket(const std::string& path)
+{
+	sockaddr_un address;
+	if (!socketAddress(path, address))
+		return -1;
+
+	// Socket left by a previous process is replaced, any other file is not touched
+	struct stat info;
+	if (stat(path.c_str(), &info) == 0) {
+		if (!S_ISSOCK(info.st_mode)) {
+			std::cout << "Socket path exists and is not a socket: " << path << '\n';
+			return -1;
+		}
+		unlink(path.c_str());
+	}
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0 || bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 16) != 0) {
+		std::cout << "Could not listen on socket " << path << ": " << strerror(errno) << '\n';
+		if (listener >= 0)
+			close(listener);
+		return -1;
+	}
+	return listener;
+}
+
+int connectSocket(const std::string& path)
+{
+	sockaddr_un address;
+	if (!socketAddress(path, address))
+		return -1;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+		std::cout << "Could not connect to " << path << ": " << strerror(errno) << '\n';
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+struct RenderJob
+{
+	uint64_t id = 0;
+	int priority = 0;
+	std::unique_ptr<Connection> connection;
+
+	std::string scenePath;
+	std::string sceneText;	// inline scene, used if scene path is empty
+	std::string output;
+	std::optional<Vec3f> cameraPos, cameraRot;
+	std::optional<float> fov;
+	std::chrono::steady_clock::time_point received;
+};
+
+bool RenderServer::JobOrder::operator()(const std::unique_ptr<RenderJob>& a, const std::unique_ptr<RenderJob>& b) const
+{
+	// Queue top is the largest job: highest priority, then the earliest one
+	if (a->priority != b->priority)
+		return a->priority < b->priority;
+	return a->id > b->id;
+}
+
+RenderServer::RenderServer(const std::string& a_socketPath, size_t cacheSize)
+	: socketPath(a_socketPath), cache(cacheSize) {}
+
+RenderServer::~RenderServer() {}
+
+int RenderServer::run()
+{
+	int listener = listenSocket(socketPath);
+	if (listener < 0)
+		return 1;
+	std::cout << "Listening on " << socketPath << '\n';
+
+	// Jobs are rendered by a thread of their own, never by pool tasks, so
+	// renders can use the whole pool
+	std::thread(&RenderServer::renderLoop, this).detach();
+	while (true) {
+		int fd = accept(listener, nullptr, nullptr);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			std::cout << "Could not accept connection: " << strerror(errno) << '\n';
+			break;
+		}
+		// Slow client must not hold up other clients
+		std::thread(&RenderServer::receiveJob, this, fd).detach();
+	}
+	close(listener);
+	return 1;
+}
+
+void RenderServer::receiveJob(int fd)
+{
+	auto job = std::make_unique<RenderJob>();
+	job->connection = std::make_unique<Connection>(fd);
+	Connection& connection = *job->connection;
+
+	std::string line;
+	while (connection.readLine(line) && line != "end") {
+		size_t separator = line.find('=');
+		if (separator == std::string::npos) {
+			connection.send("failed expected key=value: " + line);
+			return;
+		}
+		std::string key = line.substr(0, separator);
+		std::string value = line.substr(separator + 1);
+		bool valid = true;
+		Vec3f vec;
+		float number;
+		size_t count;
+		if (key == "scene") {
+			job->scenePath = value;
+		}
+		else if (key == "inline") {
+			valid = parseNumber(value, count) && count <= maxInlineScene && connection.read(count, job->sceneText);
+		}
+		else if (key == "priority") {
+			valid = parseNumber(value, job->priority);
+		}
+		else if (key == "output") {
+			job->output = value;
+		}
+		else if (key == "camera_pos") {
+			valid = parseVec3(value, vec);
+			job->cameraPos = vec;
+		}
+		else if (key == "camera_rot") {
+			valid = parseVec3(value, vec);
+			job->cameraRot = vec;
+		}
+		else if (key == "fov") {
+			valid = parseNumber(value, number);
+			job->fov = number;
+		}
+		else {
+			valid = false;
+		}
+		if (!valid) {
+			connection.send("failed invalid request line: " + line);
+			return;
+		}
+	}
+	if (line != "end")
+		return;
+	if (job->scenePath.empty() && job->sceneText.empty()) {
+		connection.send("failed job has no scene");
+		return;
+	}
+
+	// Reply is sent under the lock, so that it comes before anything render thread sends
+	std::lock_guard<std::mutex> lock(mutex);
+	job->id = nextJobId++;
+	job->received = std::chrono::steady_clock::now();
+	connection.send("queued " + std::to_string(job->id) + ' ' + std::to_string(jobs.size()));
+	jobs.push(std::move(job));
+	jobAdded.notify_one();
+}
+
+void RenderServer::renderLoop()
+{
+	while (true) {
+		std::unique_ptr<RenderJob> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAdded.wait(lock, [this]() { return !jobs.empty(); });
+			// Top is const, job is taken out of it right before pop
+			job = std::move(const_cast<std::unique_ptr<RenderJob>&>(jobs.top()));
+			jobs.pop();
+		}
+		renderJob(*job);
+	}
+}
+
+void RenderServer::renderJob(RenderJob& job)
+{
+	Connection& connection = *job.connection;
+	const std::string name = job.scenePath.empty() ? "job " + std::to_string(job.id) : job.scenePath;
+	std::cout << "Job " << job.id << ": " << name << '\n';
+
+	// Jobs run one at a time, so cache counters change only by this job
+	const size_t hits = cache.hits, misses = cache.misses;
+	Scene scene;
+	scene.assets = &cache;
+	Timer loadTimer("Loading", false);
+	scene.sceneLoadSuccess = job.scenePath.empty() ? scene.loadSceneText(job.sceneText, name) : scene.loadScene(job.scenePath);
+	connection.send("load " + std::to_string(loadTimer.stop()) + ' ' +
+		std::to_string(cache.hits - hits) + ' ' + std::to_string(cache.misses - misses));
+	if (!scene.sceneLoadSuccess) {
+		connection.send("failed " + scene.loadError);
+		return;
+	}
+
+	if (!job.output.empty())
+		scene.options.imageName = job.output;
+	if (job.cameraPos)
+		scene.camera.pos = *job.cameraPos;
+	if (job.cameraRot)
+		scene.camera.rot = *job.cameraRot;
+	if (job.fov)
+		scene.camera.fov = *job.fov;
+	scene.onProgress = [&connection](float percent) {
+		connection.send("progress " + std::to_string((int)percent));
+	};
+
+	const long long renderTime = scene.animation.enabled() ? scene.renderAnimation() : scene.render();
+	if (renderTime < 0) {
+		connection.send("failed render failed");
+		return;
+	}
+	connection.send("render " + std::to_string(renderTime));
+	connection.send("done " + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - job.received).count()));
+}
+
+int runClient(const std::string& socketPath, const std::vector<std::string>& args)
+{
+	if (args.empty()) {
+		std::cout << "Client needs scene path or - for scene on standard input\n";
+		return 1;
+	}
+
+	// Server may run in another directory, so local paths are made absolute
+	std::ostringstream request;
+	if (args[0] == "-") {
+		std::string text((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+		request << "inline=" << text.size() << '\n' << text;
+	}
+	else {
+		request << "scene=" << std::filesystem::absolute(args[0]).string() << '\n';
+	}
+	for (size_t i = 1; i < args.size(); i++) {
+		if (args[i].compare(0, 7, "output=") == 0)
+			request << "output=" << std::filesystem::absolute(args[i].substr(7)).string() << '\n';
+		else
+			request << args[i] << '\n';
+	}
+	request << "end\n";
+
+	int fd = connectSocket(socketPath);
+	if (fd < 0)
+		return 1;
+	Connection connection(fd);
+	std::string data = request.str();
+	data.pop_back();
+	if (!connection.send(data)) {
+		std::cout << "Could not send job\n";
+		return 1;
+	}
+
+	// Replies are printed as they come, job is finished with done or failed
+	std::string line;
+	while (connection.readLine(line)) {
+		std::cout << line << std::endl;
+		if (line.compare(0, 4, "done") == 0)
+			return 0;
+		if (line.compare(0, 6, "failed") == 0)
+			return 1;
+	}
+	std::cout << "Server closed connection\n";
+	return 1;
+}
+#endif // _WIN32
@@ -0,0 +1,221 @@
+// Used to store and output scene statistics
+#include "stats.h"
+
+#include <fstream>
+
+namespace
+{
+	const char* const rayTypeNames[4] = { "camera", "shadow", "reflection", "refraction" };
+
+	double ratio(size_t a, size_t b)
+	{
+		return b ? (double)a / b : 0.0;
+	}
+
+	// Depths after the last one with any rays are left out
+	size_t usedDepths(const std::atomic<size_t>* raysByDepth)
+	{
+		size_t used = statDepths;
+		while (used > 0 && raysByDepth[used - 1].load() == 0)
+			used--;
+		return used;
+	}
+
+	const char* const perfPhaseNames[perfPhaseCount] = { "load", "build", "render" };
+
+	// Formatted count, or dash if event was not counted
+	std::string perfValue(const Stats& stats, int phase, int event)
+	{
+		return stats.perfEvents.load() & (1u << event) ? std::to_string(stats.perf[phase][event].load()) : "-";
+	}
+
+	// Events per thousand instructions, or dash if either was not counted
+	void printPerKilo(const Stats& stats, int phase, int event)
+	{
+		const unsigned events = stats.perfEvents.load();
+		const uint64_t instructions = stats.perf[phase][1].load();
+		if ((events & (1u << event)) && (events & 2u) && instructions)
+			std::cout << std::setw(8) << 1000.0 * stats.perf[phase][event].load() / instructions;
+		else
+			std::cout << std::setw(8) << '-';
+	}
+
+	void writeArray(std::ostream& out, const std::vector<size_t>& values)
+	{
+		out << '[';
+		for (size_t i = 0; i < values.size(); i++)
+			out << (i ? ", " : "") << values[i];
+		out << ']';
+	}
+}
+
+void Stats::print(const TreeShape& shape) const
+{
+	std::cout.precision(2);
+	std::cout << "Statistics:\n";
+	std::cout << "Ray triangle tests:                 " << std::setw(10)
+		<< std::scientific << rayTriTests.load() << '\n';
+	std::cout << "Ray acceleration structure tests:   " << std::setw(10)
+		<< std::scientific << accelStructTests.load() << '\n';
+	std::cout << "Total intersection test:            " << std::setw(10)
+		<< std::scientific << (float)rayTriTests.load() + accelStructTests.load() << '\n';
+	std::cout << "Total triangle copies:              " << std::setw(10)
+		<< triCopiesCount.load() << '\n';
+	std::cout << "Total triangle count:               " << std::setw(10)
+		<< meshCount.load() << '\n';
+	std::cout << "Acceleration structure count:       " << std::setw(10)
+		<< acCount.load() << '\n';
+	std::cout << "Acceleration structure build ms:    " << std::setw(10)
+		<< acBuildTime.load() / 1000 << '\n';
+	if (acRefits.load()) {
+		std::cout << "Acceleration structure refits:      " << std::setw(10)
+			<< acRefits.load() << '\n';
+		std::cout << "Acceleration structure rebuilds:    " << std::setw(10)
+			<< acRebuilds.load() << '\n';
+	}
+	std::cout << "Rays casted:                        " << std::setw(10)
+		<< raysCasted.load() << '\n';
+	std::cout << "  camera / shadow:                  " << std::setw(10)
+		<< raysByType[0].load() << " / " << raysByType[1].load() << '\n';
+	std::cout << "  reflection / refraction:          " << std::setw(10)
+		<< raysByType[2].load() << " / " << raysByType[3].load() << '\n';
+	std::cout << "Pixel samples:                      " << std::setw(10)
+		<< pixelSamples.load() << '\n';
+
+	// Average tests every kind of ray needs
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "Tests per ray:        triangle        box\n";
+	for (int i = 0; i < 4; i++) {
+		std::cout << "  " << std::left << std::setw(18) << rayTypeNames[i] << std::right << std::setw(10)
+			<< ratio(rayTriTestsByType[i].load(), raysByType[i].load()) << std::setw(11)
+			<< ratio(accelStructTestsByType[i].load(), raysByType[i].load()) << '\n';
+	}
+	std::cout << "Rays by depth:                     ";
+	for (size_t depth = 0; depth < usedDepths(raysByDepth); depth++)
+		std::cout << ' ' << raysByDepth[depth].load();
+	std::cout << '\n';
+	std::cout << "Average visited leaf size:          " << std::setw(10)
+		<< ratio(leafTriangles.load(), leavesVisited.load()) << '\n';
+
+	if (shape.trees) {
+		std::cout << "Trees / nodes / leaves:             " << std::setw(10) << shape.trees << " / "
+			<< shape.nodes << " / " << shape.leaves << '\n';
+		std::cout << "Average leaf size:                  " << std::setw(10)
+			<< ratio(shape.triangleReferences, shape.leaves) << '\n';
+		std::cout << "Leaves by depth:                   ";
+		for (size_t count : shape.leavesByDepth)
+			std::cout << ' ' << count;
+		std::cout << "\nLeaves by size 0, 1, 2-3, 4-7...:  ";
+		for (size_t count : shape.leavesBySize)
+			std::cout << ' ' << count;
+		std::cout << '\n';
+	}
+	std::cout << std::defaultfloat;
+
+	for (int phase = 0; phase < perfPhaseCount; phase++) {
+		if (perfScopes[phase].load()) {
+			printPerf();
+			break;
+		}
+	}
+}
+
+void Stats::printPerf() const
+{
+	const std::string error = PerfCounters::error();
+	if (!perfEvents.load()) {
+		std::cout << "Performance counters not available" << (error.empty() ? "" : ", " + error) << '\n';
+		return;
+	}
+	std::cout << std::left << std::setw(20) << "Performance counters:" << std::right << std::setw(8) << "scopes"
+		<< std::setw(15) << "cycles" << std::setw(15) << "instructions" << std::setw(15) << "LLC misses" << std::setw(15)
+		<< "branch misses" << std::setw(12) << "CPU ms" << std::setw(8) << "IPC" << std::setw(8) << "LLC/1k"
+		<< std::setw(8) << "br/1k" << '\n';
+	for (int phase = 0; phase < perfPhaseCount; phase++) {
+		if (!perfScopes[phase].load())
+			continue;
+		std::cout << "  " << std::left << std::setw(18) << perfPhaseNames[phase] << std::right << std::setw(8)
+			<< perfScopes[phase].load();
+		for (int event = 0; event < 4; event++)
+			std::cout << std::setw(15) << perfValue(*this, phase, event);
+		std::cout << std::fixed << std::setprecision(1) << std::setw(12);
+		if (perfEvents.load() & (1u << 4))
+			std::cout << perf[phase][4].load() / 1e6;
+		else
+			std::cout << '-';
+		std::cout << std::setprecision(2) << std::setw(8);
+		if ((perfEvents.load() & 3u) == 3u && perf[phase][0].load())
+			std::cout << ratio(perf[phase][1].load(), perf[phase][0].load());
+		else
+			std::cout << '-';
+		printPerKilo(*this, phase, 2);
+		printPerKilo(*this, phase, 3);
+		std::cout << '\n';
+	}
+	if ((perfEvents.load() & ((1u << perfEventCount) - 1)) != (1u << perfEventCount) - 1) {
+		std::cout << "  not counted:";
+		for (int event = 0; event < perfEventCount; event++)
+			if (!(perfEvents.load() & (1u << event)))
+				std::cout << ' ' << PerfCounters::eventName(event);
+		std::cout << (error.empty() ? "" : " (" + error + ")") << '\n';
+	}
+	std::cout << std::defaultfloat;
+}
+
+bool Stats::writeJSON(const std::string& path, const TreeShape& shape) const
+{
+	std::ofstream file(path);
+	if (!file)
+		return false;
+	std::vector<size_t> depths;
+	for (size_t depth = 0; depth < usedDepths(raysByDepth); depth++)
+		depths.push_back(raysByDepth[depth].load());
+
+	file << std::fixed << std::setprecision(3);
+	file << "{\n  \"rays\": " << raysCasted.load() << ",\n  \"rays_by_depth\": ";
+	writeArray(file, depths);
+	file << ",\n  \"ray_types\": {\n";
+	for (int i = 0; i < 4; i++) {
+		file << "    \"" << rayTypeNames[i] << "\": { \"rays\": " << raysByType[i].load()
+			<< ", \"triangle_tests\": " << rayTriTestsByType[i].load()
+			<< ", \"box_tests\": " << accelStructTestsByType[i].load()
+			<< ", \"triangle_tests_per_ray\": " << ratio(rayTriTestsByType[i].load(), raysByType[i].load())
+			<< ", \"box_tests_per_ray\": " << ratio(accelStructTestsByType[i].load(), raysByType[i].load())
+			<< (i < 3 ? " },\n" : " }\n");
+	}
+	file << "  },\n";
+	file << "  \"triangle_tests\": " << rayTriTests.load() << ",\n";
+	file << "  \"box_tests\": " << accelStructTests.load() << ",\n";
+	file << "  \"leaves_visited\": " << leavesVisited.load() << ",\n";
+	file << "  \"average_visited_leaf_size\": " << ratio(leafTriangles.load(), leavesVisited.load()) << ",\n";
+	file << "  \"pixel_samples\": " << pixelSamples.load() << ",\n";
+	file << "  \"triangles\": " << meshCount.load() << ",\n";
+	file << "  \"tree_build_ms\": " << acBuildTime.load() / 1000.0 << ",\n";
+	file << "  \"tree_refits\": " << acRefits.load() << ",\n";
+	file << "  \"tree_rebuilds\": " << acRebuilds.load() << ",\n";
+	file << "  \"trees\": { \"count\": " << shape.trees << ", \"nodes\": " << shape.nodes << ", \"leaves\": " << shape.leaves
+		<< ", \"triangle_references\": " << shape.triangleReferences
+		<< ", \"average_leaf_size\": " << ratio(shape.triangleReferences, shape.leaves) << ",\n    \"leaves_by_depth\": ";
+	writeArray(file, shape.leavesByDepth);
+	file << ",\n    \"leaves_by_size\": ";
+	writeArray(file, shape.leavesBySize);
+	file << " }";
+
+	// Only phases that were counted, with the events that could be read
+	bool first = true;
+	for (int phase = 0; phase < perfPhaseCount; phase++) {
+		if (!perfScopes[phase].load())
+			continue;
+		file << (first ? ",\n  \"perf\": {\n" : ",\n") << "    \"" << perfPhaseNames[phase] << "\": { \"scopes\": "
+			<< perfScopes[phase].load();
+		for (int event = 0; event < perfEventCount; event++)
+			if (perfEvents.load() & (1u << event))
+				file << ", \"" << PerfCounters::eventName(event) << "\": " << perf[phase][event].load();
+		file << " }";
+		first = false;
+	}
+	if (!first)
+		file << "\n  }";
+	file << "\n}\n";
+	return (bool)file;
+}
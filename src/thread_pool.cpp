@@ -0,0 +1,50 @@
+// Fixed size thread pool, used to run independent tasks such as asset loading and rendering
+#include "thread_pool.h"
+
+#include <algorithm>
+
+#include "profiler.h"
+
+ThreadPool::ThreadPool(size_t nThreads)
+{
+	if (nThreads == 0)
+		nThreads = std::max(1u, std::thread::hardware_concurrency());
+	workers.reserve(nThreads);
+	for (size_t i = 0; i < nThreads; i++)
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	// Finish all scheduled tasks before joining
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	condition.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+}
+
+ThreadPool& ThreadPool::shared()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::workerLoop()
+{
+	PROFILE_THREAD("Pool thread");
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+			if (tasks.empty())
+				return;
+			task = std::move(tasks.front());
+			tasks.pop();
+		}
+		task();
+	}
+}
@@ -0,0 +1,223 @@
+// Time budget of a render, lowers quality tile by tile to finish in time
+#include "time_budget.h"
+
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+
+#include "scene.h"
+#include "profiler.h"
+
+namespace
+{
+	const double pilotMargin = 0.9;	// part of time left that chosen level may use
+	const double lowerMargin = 0.95;	// level is lowered when it needs more than this part of time left
+	const double raiseMargin = 0.7;	// better level has to fit into this part of time left
+
+	double nanoseconds(std::chrono::steady_clock::duration duration)
+	{
+		return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+	}
+
+	bool sameQuality(const Quality& a, const Quality& b)
+	{
+		return a.maxRayDepth == b.maxRayDepth && a.areaLightSamples == b.areaLightSamples &&
+			a.antialiasing == b.antialiasing && a.aaMaxSamples == b.aaMaxSamples;
+	}
+}
+
+TimeBudget::TimeBudget(RenderContext& a_ctx, size_t a_firstTile, size_t endTile)
+	: ctx(a_ctx), start(std::chrono::steady_clock::now()),
+	deadline(start + std::chrono::milliseconds(a_ctx.options.timeBudget)), firstTile(a_firstTile)
+{
+	const Options& options = ctx.options;
+	Quality full(options);
+	full.areaLightSamples = 1;
+	for (const AreaLightRecord& light : ctx.compiled.areaLights)
+		full.areaLightSamples = std::max(full.areaLightSamples, light.sampleCount);
+	levels.push_back(full);
+
+	// Every step lowers one knob, steps that change nothing are left out
+	auto lower = [this](const std::function<void(Quality&)>& change) {
+		Quality next = levels.back();
+		change(next);
+		if (!sameQuality(next, levels.back()))
+			levels.push_back(next);
+	};
+	lower([&](Quality& q) { if (q.antialiasing) q.aaMaxSamples = std::min(q.aaMaxSamples, std::max(1, options.aaMinSamples)); });
+	lower([](Quality& q) { q.areaLightSamples = std::min(q.areaLightSamples, 4u); });
+	lower([](Quality& q) { q.antialiasing = false; });
+	lower([](Quality& q) { q.areaLightSamples = 1; });
+	lower([](Quality& q) { q.maxRayDepth = std::min(q.maxRayDepth, 2); });
+	lower([](Quality& q) { q.maxRayDepth = std::min(q.maxRayDepth, 1); });
+	lower([](Quality& q) { q.maxRayDepth = 0; });
+
+	pilotCost.assign(levels.size(), -1);
+	renderCost.assign(levels.size(), -1);
+	levelTiles.assign(levels.size(), 0);
+	busyTime.assign(levels.size(), 0);
+	busyWeight.assign(levels.size(), 0);
+
+	// Until pilot runs every pixel weighs the same, restored tiles weigh nothing
+	size_t x0, y0, x1, y1;
+	weights.assign(endTile - firstTile, 0);
+	for (size_t tile = firstTile; tile < endTile; tile++) {
+		if (tile < ctx.skipTiles.size() && ctx.skipTiles[tile])
+			continue;
+		ctx.tileRect(tile, x0, y0, x1, y1);
+		weights[tile - firstTile] = (double)(x1 - x0) * (y1 - y0);
+		pixelCount += (x1 - x0) * (y1 - y0);
+	}
+	totalWeight = (double)pixelCount;
+}
+
+void TimeBudget::pilot()
+{
+	PROFILE_ZONE("Time budget pilot");
+	// Grid of about 1/256 of pixels, but at least 64 of them
+	const Options& options = ctx.options;
+	const size_t stride = std::max<size_t>(1, std::min<size_t>(16, (size_t)std::sqrt(options.width * options.height / 64.0)));
+	const size_t columns = (options.width + stride - 1 - stride / 2) / stride;
+	const size_t rows = (options.height + stride - 1 - stride / 2) / stride;
+	const size_t nWorkers = std::max(1, options.nWorkers);
+	const size_t tileSize = std::max(1, options.tileSize);
+	const size_t tilesX = (options.width + tileSize - 1) / tileSize;
+
+	// Full quality pass also times every pixel, workers sum times of their own rows
+	std::vector<std::vector<double>> tileTimes(nWorkers, std::vector<double>(weights.size(), 0));
+	std::vector<std::vector<size_t>> tileSamples(nWorkers, std::vector<size_t>(weights.size(), 0));
+	for (current = 0; current < levels.size(); current++) {
+		auto passStart = std::chrono::steady_clock::now();
+		ctx.launchWorkers([&](size_t worker, TraceState& state) {
+			state.quality = levels[current];
+			for (size_t row = worker; row < rows; row += nWorkers) {
+				for (size_t column = 0; column < columns; column++) {
+					const size_t x = stride / 2 + column * stride, y = stride / 2 + row * stride;
+					auto pixelStart = std::chrono::steady_clock::now();
+					ctx.renderPixel(x, y, state);
+					const size_t tile = y / tileSize * tilesX + x / tileSize;
+					if (current == 0 && tile >= firstTile && tile - firstTile < weights.size()) {
+						tileTimes[worker][tile - firstTile] += nanoseconds(std::chrono::steady_clock::now() - pixelStart);
+						tileSamples[worker][tile - firstTile]++;
+					}
+				}
+			}
+		});
+		auto now = std::chrono::steady_clock::now();
+		pilotCost[current] = nanoseconds(now - passStart) / std::max<size_t>(1, rows * columns);
+		if (current == 0)
+			fullEstimate = pilotCost[0] * pixelCount / 1e6;
+		if (pilotCost[current] * pixelCount <= pilotMargin * nanoseconds(deadline - now))
+			break;
+	}
+	current = std::min(current, levels.size() - 1);
+
+	// Tile weighs its pixels times average cost of its pilot pixels, tiles the grid
+	// missed get average cost of all pilot pixels
+	double timeSum = 0;
+	size_t sampleSum = 0;
+	for (size_t worker = 0; worker < nWorkers; worker++) {
+		for (size_t i = 0; i < weights.size(); i++) {
+			timeSum += tileTimes[worker][i];
+			sampleSum += tileSamples[worker][i];
+		}
+	}
+	const double averageCost = sampleSum ? timeSum / sampleSum : 1.0;
+	totalWeight = 0;
+	for (size_t i = 0; i < weights.size(); i++) {
+		double time = 0;
+		size_t samples = 0;
+		for (size_t worker = 0; worker < nWorkers; worker++) {
+			time += tileTimes[worker][i];
+			samples += tileSamples[worker][i];
+		}
+		weights[i] *= samples ? time / samples : averageCost;
+		totalWeight += weights[i];
+	}
+}
+
+size_t TimeBudget::level() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return current;
+}
+
+void TimeBudget::tileFinished(size_t tile, size_t tileLevel, std::chrono::steady_clock::duration tileTime)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	const double weight = weights[tile - firstTile];
+	finishedWeight += weight;
+	levelTiles[tileLevel]++;
+
+	// Level is charged only with time of its own tiles, so tiles of previous level
+	// still in flight do not count. Workers render in parallel, so wall time is busy
+	// time shared by them, and it is measured once there were as many tiles as workers
+	const size_t nWorkers = std::max(1, ctx.options.nWorkers);
+	busyTime[tileLevel] += nanoseconds(tileTime);
+	busyWeight[tileLevel] += weight;
+	if (levelTiles[tileLevel] < nWorkers || busyWeight[tileLevel] <= 0)
+		return;
+	renderCost[tileLevel] = busyTime[tileLevel] / busyWeight[tileLevel] / nWorkers;
+	if (tileLevel != current)
+		return;
+
+	auto now = std::chrono::steady_clock::now();
+	const double remaining = std::max(0.0, totalWeight - finishedWeight);
+	const double timeLeft = nanoseconds(deadline - now);
+	if (remaining * renderCost[current] > lowerMargin * timeLeft && current + 1 < levels.size())
+		current++;
+	else if (current > 0 && estimate(current - 1) >= 0 && remaining * estimate(current - 1) < raiseMargin * timeLeft)
+		current--;
+}
+
+double TimeBudget::estimate(size_t level) const
+{
+	// Pilot gives cost of levels relative to the measured one
+	if (renderCost[level] >= 0)
+		return renderCost[level];
+	if (pilotCost[level] > 0 && pilotCost[current] > 0 && renderCost[current] >= 0)
+		return pilotCost[level] / pilotCost[current] * renderCost[current];
+	return -1;
+}
+
+std::string TimeBudget::describe(const Quality& quality) const
+{
+	const Quality& full = levels[0];
+	std::string text;
+	auto add = [&text](const std::string& part) {
+		text += (text.empty() ? "" : ", ") + part;
+	};
+	if (full.antialiasing && !quality.antialiasing)
+		add("no anti-aliasing");
+	else if (quality.aaMaxSamples != full.aaMaxSamples)
+		add("anti-aliasing samples " + std::to_string(full.aaMaxSamples) + " -> " + std::to_string(quality.aaMaxSamples));
+	if (quality.areaLightSamples != full.areaLightSamples)
+		add("area light samples " + std::to_string(full.areaLightSamples) + " -> " + std::to_string(quality.areaLightSamples));
+	if (quality.maxRayDepth != full.maxRayDepth)
+		add("ray depth " + std::to_string(full.maxRayDepth) + " -> " + std::to_string(quality.maxRayDepth));
+	return text;
+}
+
+void TimeBudget::report() const
+{
+	const long long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Time budget " << ctx.options.timeBudget << " ms, used " << elapsed << " ms, full quality estimated at "
+		<< (long long)fullEstimate << " ms\n";
+	size_t tiles = 0;
+	for (size_t count : levelTiles)
+		tiles += count;
+	if (levelTiles[0] == tiles) {
+		std::cout << "All tiles rendered at full quality\n";
+		return;
+	}
+	for (size_t level = 0; level < levels.size(); level++) {
+		if (levelTiles[level] == 0)
+			continue;
+		std::cout << levelTiles[level] << " of " << tiles << " tiles ";
+		if (level == 0)
+			std::cout << "at full quality\n";
+		else
+			std::cout << "degraded: " << describe(levels[level]) << '\n';
+	}
+}
@@ -1,113 +1,121 @@
-// utility functions and functions working with file IO
-#include "util.h"
-
-#ifdef _WIN32
-    #define NOMINMAX
-    #include "windows.h"
-    #include "shellapi.h"
-#endif // _WIN32
-
-#include <fstream>
-#include <cstring>
-
-#include "options.h"
-
-int saveImage(Vec3f* frameBuffer, const Options& options)
-{
-    std::string path = options.imageName + std::string(".bmp");
-    std::ofstream of(path, std::ios::out | std::ios::binary);
-    if (!of.good()) {
-        std::cout << "Could not open output file " << path << '\n';
-        return -1;
-    }
-    
-    std::cout << "Successfully wrote to output file " << path << '\n';
-
-    const size_t headerSize = 54;
-    char header[headerSize] = { 0 };
-    int paddingBytes = options.width % 4 == 0 ? 0 : 4 - options.width * 3 % 4;
-    size_t arraySize = options.height * (options.width + paddingBytes) * 3;
-    size_t totalSize = headerSize + arraySize;
-
-    
-    memcpy(header, "BM", 2);
-    *(size_t*)(header + 0x2) = totalSize;
-    *(size_t*)(header + 0xA) = headerSize;
-    *(size_t*)(header + 0xE) = headerSize - 14;
-    *(size_t*)(header + 0x12) = options.width;
-    *(size_t*)(header + 0x16) = options.height;
-    *(header + 0x1A) = 1;
-    *(header + 0x1C) = 24;
-    *(size_t*)(header + 0x22) = arraySize;
-    *(size_t*)(header + 0x26) = 2835;
-    *(size_t*)(header + 0x2A) = 2835;
-
-    // intermediate buffer significantly speeds up file write process
-    char* data = new char[options.height * options.width * 3];
-    char* dataPtr = data;
-    for (size_t i = 0; i < options.height; i++) {
-        for (size_t j = 0; j < options.width; j++) {
-            size_t v = (options.height - 1 - i) * options.width + j;
-            for (int k = 2; k >= 0; k--) {
-                *dataPtr++ = static_cast<char>(clamp(0.0f, 1.0f, frameBuffer[v][k]) * 255);
-            }
-        }
-        for (int j = 0; j < paddingBytes; j++) {
-            dataPtr++;
-        }
-    }
-
-    of.write(header, headerSize);
-    of.write(data, arraySize);
-    of.close();
-
-    std::string fullPath = (std::filesystem::current_path() / path).string();
-    #ifdef _WIN32
-        wchar_t* wPath = new wchar_t[strlen(fullPath.c_str()) + 1];
-        mbstowcs(wPath, fullPath.c_str(), strlen(fullPath.c_str()) + 1);
-        ShellExecute(NULL, L"open", wPath, NULL, NULL, SW_SHOWDEFAULT);
-        delete[] wPath;
-    #elif __linux__
-        auto linuxCmd = "xdg-open " + fullPath;
-        system(linuxCmd.c_str());
-    #endif
-    delete[] data;
-    return 0;
-}
-
-unsigned char* loadBMP(const char* filename, int& width, int& height)
-{
-    int i;
-    FILE* f = fopen(filename, "rb");
-    if (f == NULL) {
-        std::cout << "Could not open .bmp file: " << filename << '\n';
-        LOG_ERROR();
-        return NULL;
-    }
-    unsigned char info[54];
-
-    // read the 54-byte header
-    fread(info, sizeof(unsigned char), 54, f);
-
-    // extract image height and width from header
-    width = *(int*)&info[18];
-    height = *(int*)&info[22];
-
-    // allocate 3 bytes per pixel
-    int size = 3 * width * height;
-    unsigned char* data = new unsigned char[size];
-
-    // read the rest of the data at once
-    fread(data, sizeof(unsigned char), size, f);
-    fclose(f);
-
-    for (i = 0; i < size; i += 3)
-    {
-        // flip the order of every 3 bytes
-        unsigned char tmp = data[i];
-        data[i] = data[i + 2];
-        data[i + 2] = tmp;
-    }
-
-    return data;
-}
+// utility functions and functions working with file IO
+#include "util.h"
+
+#ifndef _WIN32
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif // _WIN32
+
+#include <fstream>
+#include <iterator>
+#include <cstring>
+
+#include "options.h"
+
+MappedFile::MappedFile(const std::string& path)
+{
+#ifdef _WIN32
+    std::ifstream ifs(path, std::ios::in | std::ios::binary);
+    if (!ifs.good())
+        return;
+    buffer.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    data = buffer.data();
+    size = buffer.size();
+    opened = true;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        size = (size_t)st.st_size;
+        if (size == 0) {
+            opened = true;
+        }
+        else {
+            void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                madvise(mapping, size, MADV_SEQUENTIAL);
+                data = static_cast<const char*>(mapping);
+                opened = true;
+            }
+        }
+    }
+    close(fd);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+    if (data != nullptr)
+        munmap(const_cast<char*>(data), size);
+#endif
+}
+
+unsigned char* loadBMP(const char* filename, int& width, int& height)
+{
+    size_t i;
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL) {
+        std::cout << "Could not open .bmp file: " << filename << '\n';
+        return NULL;
+    }
+    unsigned char info[54];
+
+    // read the 54-byte header
+    if (fread(info, sizeof(unsigned char), 54, f) != 54 || info[0] != 'B' || info[1] != 'M') {
+        std::cout << "Invalid .bmp header: " << filename << '\n';
+        fclose(f);
+        return NULL;
+    }
+
+    // extract image height and width from header
+    width = *(int*)&info[18];
+    height = *(int*)&info[22];
+    if (width <= 0 || height <= 0) {
+        std::cout << "Invalid .bmp size: " << filename << '\n';
+        fclose(f);
+        return NULL;
+    }
+
+    // allocate 3 bytes per pixel
+    size_t size = 3 * (size_t)width * height;
+    unsigned char* data = new unsigned char[size];
+
+    // read the rest of the data at once
+    const bool read = fread(data, sizeof(unsigned char), size, f) == size;
+    fclose(f);
+    if (!read) {
+        std::cout << "Could not read .bmp data: " << filename << '\n';
+        delete[] data;
+        return NULL;
+    }
+
+    for (i = 0; i < size; i += 3)
+    {
+        // flip the order of every 3 bytes
+        unsigned char tmp = data[i];
+        data[i] = data[i + 2];
+        data[i + 2] = tmp;
+    }
+
+    return data;
+}
+
+bool readBMPSize(const char* filename, int& width, int& height)
+{
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL)
+        return false;
+    unsigned char info[54];
+    const bool read = fread(info, sizeof(unsigned char), 54, f) == 54;
+    fclose(f);
+    if (!read)
+        return false;
+    width = *(int*)&info[18];
+    height = *(int*)&info[22];
+    return true;
+}